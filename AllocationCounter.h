@@ -0,0 +1,123 @@
+/****************************************/
+/* Heap allocation counter              */
+/* Replaces the global operator new so  */
+/* a program can count the allocations  */
+/* made by a section of code            */
+/****************************************/
+
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <atomic>
+#include <new>
+#include <stdint.h>
+#include <stdlib.h>
+
+//The replacement operators below are ordinary definitions, so include this
+//header from the translation unit holding main() and nowhere else
+class AllocationCounter
+{
+public:
+	//Allocations made through operator new since the program started
+	static uint64_t count()
+	{
+		return counter().load(std::memory_order_relaxed);
+	}
+
+	static void record()
+	{
+		counter().fetch_add(1, std::memory_order_relaxed);
+	}
+
+private:
+	static std::atomic<uint64_t> &counter()
+	{
+		static std::atomic<uint64_t> allocations(0);
+		return allocations;
+	}
+};
+
+void *operator new(size_t size)
+{
+	AllocationCounter::record();
+	void *p = malloc(size ? size : 1);
+	if(!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+	AllocationCounter::record();
+	return malloc(size ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &tag) noexcept
+{
+	return operator new(size, tag);
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+	free(p);
+}
+
+#ifdef __cpp_aligned_new
+//Over-aligned types bypass operator new(size_t), so count them here too
+void *operator new(size_t size, std::align_val_t align)
+{
+	AllocationCounter::record();
+	size_t alignment = static_cast<size_t>(align);
+	void *p = aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+	if(!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void *operator new[](size_t size, std::align_val_t align)
+{
+	return operator new(size, align);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept
+{
+	free(p);
+}
+
+void operator delete(void *p, size_t, std::align_val_t) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p, size_t, std::align_val_t) noexcept
+{
+	free(p);
+}
+#endif
+
+#endif
@@ -0,0 +1,205 @@
+/****************************************/
+/* Encrypted columnar store             */
+/* Serialized ciphertext chunks kept in */
+/* <path>.dat, indexed by column and    */
+/* chunk id in <path>.idx, along with   */
+/* the configuration they were written  */
+/* with                                 */
+/****************************************/
+
+#ifndef ENCRYPTED_STORE_H
+#define ENCRYPTED_STORE_H
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <utility>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//Read-only stream buffer over one chunk of the mapped data file, so the
+//library deserializers read straight out of the page cache without an
+//intermediate copy of the file
+class MappedChunkBuf : public std::streambuf
+{
+public:
+	MappedChunkBuf(const char *data, size_t size)
+	{
+		char *begin = const_cast<char *>(data);
+		setg(begin, begin, begin + size);
+	}
+
+protected:
+	pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+	{
+		char *base = (dir == std::ios_base::beg) ? eback() : (dir == std::ios_base::cur) ? gptr() : egptr();
+		char *target = base + off;
+
+		if(!(which & std::ios_base::in) || target < eback() || target > egptr())
+			return pos_type(off_type(-1));
+
+		setg(eback(), target, egptr());
+		return pos_type(target - eback());
+	}
+
+	pos_type seekpos(pos_type pos, std::ios_base::openmode which)
+	{
+		return seekoff(off_type(pos), std::ios_base::beg, which);
+	}
+};
+
+//Appends serialized chunks to <path>.dat and records them in <path>.idx
+class EncryptedStoreWriter
+{
+public:
+	explicit EncryptedStoreWriter(const std::string &path)
+		: data_((path + ".dat").c_str(), std::ios::binary | std::ios::trunc),
+		  index_((path + ".idx").c_str(), std::ios::trunc),
+		  chunk_(0), offset_(0)
+	{
+		if(!data_ || !index_)
+			throw std::runtime_error("could not create encrypted store " + path);
+	}
+
+	//Returns the stream the next chunk is serialized into; end_chunk() closes it
+	std::ostream &begin_chunk(const std::string &column, uint32_t chunk)
+	{
+		column_ = column;
+		chunk_ = chunk;
+		offset_ = data_.tellp();
+		return data_;
+	}
+
+	void end_chunk()
+	{
+		uint64_t end = data_.tellp();
+		index_ << column_ << " " << chunk_ << " " << offset_ << " " << (end - offset_) << "\n";
+	}
+
+	//Records a configuration value such as the number of records, so later
+	//runs can tell what the stored columns were encrypted with
+	void set_attribute(const std::string &name, uint64_t value)
+	{
+		index_ << "@" << name << " " << value << "\n";
+	}
+
+private:
+	EncryptedStoreWriter(const EncryptedStoreWriter &);
+	EncryptedStoreWriter &operator=(const EncryptedStoreWriter &);
+
+	std::ofstream data_;
+	std::ofstream index_;
+	std::string column_;
+	uint32_t chunk_;
+	uint64_t offset_;
+};
+
+//Memory-maps <path>.dat read-only. Pages are only faulted in when a chunk
+//is loaded, so a query touching one column never reads the others.
+class EncryptedStore
+{
+public:
+	explicit EncryptedStore(const std::string &path)
+		: fd_(-1), base_(NULL), size_(0)
+	{
+		std::ifstream index((path + ".idx").c_str());
+		if(!index)
+			throw std::runtime_error("could not open store index " + path + ".idx");
+
+		std::string line;
+		while(std::getline(index, line))
+		{
+			std::istringstream fields(line);
+			std::string column;
+			uint32_t chunk;
+			uint64_t value;
+			Entry entry;
+			if(line[0] == '@' && fields >> column >> value)
+				attributes_[column.substr(1)] = value;
+			else if(fields >> column >> chunk >> entry.offset >> entry.size)
+				entries_[std::make_pair(column, chunk)] = entry;
+		}
+
+		fd_ = open((path + ".dat").c_str(), O_RDONLY);
+		if(fd_ < 0)
+			throw std::runtime_error("could not open store data " + path + ".dat");
+
+		struct stat st;
+		fstat(fd_, &st);
+		size_ = st.st_size;
+
+		if(size_ > 0)
+		{
+			void *map = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+			if(map == MAP_FAILED)
+			{
+				close(fd_);
+				throw std::runtime_error("could not map store data " + path + ".dat");
+			}
+			base_ = static_cast<const char *>(map);
+			madvise(map, size_, MADV_RANDOM);
+		}
+	}
+
+	~EncryptedStore()
+	{
+		if(base_ != NULL)
+			munmap(const_cast<char *>(base_), size_);
+		if(fd_ >= 0)
+			close(fd_);
+	}
+
+	static bool exists(const std::string &path)
+	{
+		struct stat st;
+		return stat((path + ".idx").c_str(), &st) == 0 && stat((path + ".dat").c_str(), &st) == 0;
+	}
+
+	//Returns fallback if the store was written without this attribute
+	uint64_t attribute(const std::string &name, uint64_t fallback) const
+	{
+		std::map<std::string, uint64_t>::const_iterator it = attributes_.find(name);
+		return it == attributes_.end() ? fallback : it->second;
+	}
+
+	//Hands load_fn a stream positioned on the requested chunk
+	template <typename LoadFn>
+	void load(const std::string &column, uint32_t chunk, LoadFn load_fn) const
+	{
+		std::map<Key, Entry>::const_iterator it = entries_.find(std::make_pair(column, chunk));
+		if(it == entries_.end())
+			throw std::runtime_error("store has no chunk " + column);
+		if(it->second.offset + it->second.size > size_)
+			throw std::runtime_error("store chunk " + column + " runs past end of data file");
+
+		MappedChunkBuf buf(base_ + it->second.offset, it->second.size);
+		std::istream in(&buf);
+		load_fn(in);
+	}
+
+private:
+	typedef std::pair<std::string, uint32_t> Key;
+	struct Entry
+	{
+		uint64_t offset;
+		uint64_t size;
+	};
+
+	EncryptedStore(const EncryptedStore &);
+	EncryptedStore &operator=(const EncryptedStore &);
+
+	std::map<Key, Entry> entries_;
+	std::map<std::string, uint64_t> attributes_;
+	int fd_;
+	const char *base_;
+	size_t size_;
+};
+
+#endif
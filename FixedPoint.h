@@ -0,0 +1,72 @@
+/****************************************/
+/* Fixed-point encoding for BFV/BGV     */
+/* Reals are scaled by 2^bits and       */
+/* rounded to integers; the scale of a  */
+/* product is the sum of the scales     */
+/****************************************/
+
+#ifndef FIXED_POINT_H
+#define FIXED_POINT_H
+
+#include <math.h>
+#include <vector>
+#include <stdint.h>
+
+class FixedPointCodec
+{
+public:
+	explicit FixedPointCodec(int frac_bits)
+		: frac_bits_(frac_bits)
+	{
+	}
+
+	//Scale, in bits, of freshly encoded inputs
+	int input_scale() const
+	{
+		return frac_bits_;
+	}
+
+	//Scale of the product of two encodings. Anything added to the product
+	//has to be encoded at this scale.
+	static int product_scale(int a, int b)
+	{
+		return a + b;
+	}
+
+	std::vector<int64_t> encode(const std::vector<double> &values, int scale_bits) const
+	{
+		std::vector<int64_t> encoded(values.size());
+		for(size_t i = 0; i < values.size(); i++)
+			encoded[i] = llround(ldexp(values[i], scale_bits));
+		return encoded;
+	}
+
+	std::vector<double> decode(const std::vector<int64_t> &values, int scale_bits) const
+	{
+		std::vector<double> decoded(values.size());
+		for(size_t i = 0; i < values.size(); i++)
+			decoded[i] = ldexp((double)values[i], -scale_bits);
+		return decoded;
+	}
+
+	//Largest error rounding the inputs can leave in v + a*t, for |a| <= a_max
+	//and |t| <= t_max encoded at the input scale and v at the product scale.
+	//Anything larger means the result wrapped around the plaintext modulus.
+	double rounding_error(double a_max, double t_max) const
+	{
+		double step = ldexp(0.5, -frac_bits_);
+		return (a_max + t_max) * step + step * step + ldexp(0.5, -2 * frac_bits_);
+	}
+
+	//Plaintext modulus size that holds every signed value with |x| <= bound at
+	//scale 2^scale_bits without wrapping: one bit for the sign, one for rounding
+	static int plain_modulus_bits(double bound, int scale_bits)
+	{
+		return (int)ceil(log2(bound)) + scale_bits + 2;
+	}
+
+private:
+	int frac_bits_;
+};
+
+#endif
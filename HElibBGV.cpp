@@ -6,14 +6,35 @@
 /* final velocity = V_i + at   m/s     */
 /***************************************/
 #include <iostream>
+#include <memory>
+#include <sstream>
 #include <vector>
 #include <time.h>
 #include <stdlib.h>
+#include <string.h>
 #include <helib/helib.h>
+#include "IncrementalCache.h"
+#include "Telemetry.h"
+#include "AllocationCounter.h"
 
 using namespace std;
 using namespace helib;
 
+//Largest log2(q) the HE standard allows for a ternary secret, classical
+//attacks; rows are ring dimensions 1024 ... 32768, columns 128/192/256 bits
+long max_modulus_bits(unsigned long ring_dim, int security)
+{
+	static const long table[6][3] = {
+		{ 27, 19, 14 }, { 54, 37, 29 }, { 109, 75, 58 },
+		{ 218, 152, 118 }, { 438, 305, 237 }, { 881, 611, 476 } };
+
+	int column = (security == 128) ? 0 : (security == 192) ? 1 : (security == 256) ? 2 : -1;
+	for(int row = 0; row < 6; row++)
+		if(column >= 0 && ring_dim == (1024UL << row))
+			return table[row][column];
+	return -1;
+}
+
 void print(vector<long> v, long length)
 {
 
@@ -23,6 +44,16 @@ void print(vector<long> v, long length)
     cout << endl;
     cout << "    [";
 
+    if (length <= print_size + end_size)
+    {
+        for (int i = 0; i < length; i++)
+        {
+            cout << setw(3) << right << v[i] << ((i != length - 1) ? "," : " ]\n");
+        }
+        cout << endl;
+        return;
+    }
+
     for (int i = 0; i < print_size; i++)
     {
         cout << setw(3) << right << v[i] << ",";
@@ -38,8 +69,44 @@ void print(vector<long> v, long length)
     cout << endl;
 }
 
-int main()
+int main(int argc, char *argv[])
 {
+	//--no-compact returns the result at the level evaluation ended on.
+	//--updates R then runs R incremental update rounds in which acceleration
+	//and time each change with probability --churn percent.
+	//--telemetry <csv> records the capacity and level after every operation.
+	//--security K rejects contexts HElib estimates below K bits. --ring-dim D
+	//uses the fully packed power-of-two cyclotomic of degree D, with a modulus
+	//chain sized for D and K, and --n N fills N slots.
+	//--stream R re-evaluates the inputs R times and counts heap allocations.
+	bool compact = true;
+	Telemetry telemetry;
+	int updates = 0;
+	int churn = 5;
+	int security = 128;
+	unsigned long ring_dim = 0;
+	long N = -1;
+	int stream_runs = 0;
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "--no-compact") == 0)
+			compact = false;
+		else if(strcmp(argv[i], "--updates") == 0 && i + 1 < argc)
+			updates = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--churn") == 0 && i + 1 < argc)
+			churn = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--telemetry") == 0 && i + 1 < argc)
+			telemetry.enable(argv[++i]);
+		else if(strcmp(argv[i], "--security") == 0 && i + 1 < argc)
+			security = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--ring-dim") == 0 && i + 1 < argc)
+			ring_dim = atol(argv[++i]);
+		else if(strcmp(argv[i], "--n") == 0 && i + 1 < argc)
+			N = atol(argv[++i]);
+		else if(strcmp(argv[i], "--stream") == 0 && i + 1 < argc)
+			stream_runs = atoi(argv[++i]);
+	}
+
 	srand(time(NULL));
 	/*****Set Parameters*****/
 	clock_t cc_clock;
@@ -50,10 +117,36 @@ int main()
 	unsigned long bits_mod_chain = 300;
 	unsigned long key_switch_col = 2;
 
+	//m = 2D with p = 65537 = 1 mod m splits completely, so all D slots are
+	//usable. The chain takes the HE standard's modulus budget for D and the
+	//security level, less the special primes key switching adds (about 1/c).
+	if(ring_dim)
+	{
+		long max_bits = max_modulus_bits(ring_dim, security);
+		if(max_bits < 0)
+		{
+			cerr << "--ring-dim must be a power of two from 1024 to 32768" << endl;
+			return 2;
+		}
+		prime_mod = 65537;
+		cyc_poly = 2 * ring_dim;
+		bits_mod_chain = max_bits * key_switch_col / (key_switch_col + 1);
+	}
+
 	//Generate context and add primes to chain
 	Context context(cyc_poly, prime_mod, 1);
 	buildModChain(context, bits_mod_chain, key_switch_col);
 	std::cout << "Security: " << context.securityLevel() << std::endl;
+	if(context.securityLevel() < security)
+	{
+		cerr << "No valid parameters for ring dimension " << context.getPhiM() << " at " << security << "-bit security" << endl;
+		return 2;
+	}
+	if(telemetry.enabled())
+	{
+		telemetry.value("context", "security_level", context.securityLevel());
+		telemetry.value("context", "bits_mod_chain", bits_mod_chain);
+	}
 
 	cc_clock = clock() - cc_clock;
 
@@ -69,27 +162,42 @@ int main()
 	const EncryptedArray& ea = *(context.ea);
 	long num_slots = ea.size(); //24
 	std::cout << "Number of slots: " << num_slots << std::endl;
+	if(N < 0)
+		N = num_slots;
+	if(N > num_slots)
+	{
+		cerr << "--n " << N << " does not fit in " << num_slots << " slots" << endl;
+		return 2;
+	}
 
 	key_clock = clock() - key_clock;
 
+	//Records HElib's own noise estimate for ct after op; no secret key needed
+	auto probe = [&](const char *op, const Ctxt &ct)
+	{
+		if(!telemetry.enabled())
+			return;
+		clock_t probe_clock;
+		probe_clock = clock();
+		telemetry.margin(op, "bit_capacity", ct.bitCapacity());
+		telemetry.value(op, "capacity", ct.capacity());
+		telemetry.value(op, "level", ct.findBaseLevel());
+		telemetry.add_overhead(clock() - probe_clock);
+	};
+
 	//Encryption
 	clock_t enc_clock;
 	enc_clock = clock();
 
-	vector<long> initial_velocity;
-	vector<long> times;
-	vector<long> acc;
+	vector<long> initial_velocity(num_slots, 0);
+	vector<long> times(num_slots, 0);
+	vector<long> acc(num_slots, 0);
 
-	for(int i = 0; i < num_slots; i++)
+	for(int i = 0; i < N; i++)
 	{
-		int64_t a = rand() % 25;
-		acc.push_back(a);
-
-		int64_t b = rand() % 50;
-		initial_velocity.push_back(b);
-
-		int64_t c = rand() % 30;
-		times.push_back(c);
+		acc[i] = rand() % 25;
+		initial_velocity[i] = rand() % 50;
+		times[i] = rand() % 30;
 	}
 
 	Ctxt enc_initial_vel(public_key);
@@ -99,8 +207,11 @@ int main()
 	ea.encrypt(enc_initial_vel, public_key, initial_velocity);
 	ea.encrypt(enc_times, public_key, times);
 	ea.encrypt(enc_acc, public_key, acc);
+	probe("encrypt initial_velocity", enc_initial_vel);
+	probe("encrypt times", enc_times);
+	probe("encrypt acc", enc_acc);
 
-	enc_clock = clock() - enc_clock;
+	enc_clock = clock() - enc_clock - telemetry.take_overhead();
 
 	//Evaluation
 	clock_t eval_clock;
@@ -108,9 +219,48 @@ int main()
 
 	enc_final_vel += enc_acc;
 	enc_final_vel *= enc_times;
+	probe("multiply", enc_final_vel);
 	enc_final_vel += enc_initial_vel;
+	probe("add", enc_final_vel);
 
-	eval_clock = clock() - eval_clock;
+	eval_clock = clock() - eval_clock - telemetry.take_overhead();
+
+	//Small chains leave no room for the product; the result would not decrypt
+	if(enc_final_vel.bitCapacity() <= 0)
+	{
+		cerr << "No capacity left after evaluation with a " << bits_mod_chain << "-bit modulus chain" << endl;
+		return 3;
+	}
+
+	//Compact
+	//Drop primes from the result while its estimated capacity stays above a
+	//safety margin. HElib tracks the noise itself, so no secret key is needed.
+	const long capacity_margin = 8;
+
+	stringstream full_stream;
+	full_stream << enc_final_vel;
+	size_t full_size = full_stream.str().size();
+
+	clock_t compact_clock;
+	compact_clock = clock();
+
+	while(compact)
+	{
+		long level = enc_final_vel.findBaseLevel();
+		Ctxt switched(enc_final_vel);
+		switched.modDownToLevel(level - 1);
+		if(switched.findBaseLevel() >= level || switched.bitCapacity() < capacity_margin)
+			break;
+		enc_final_vel = switched;
+		probe("mod_down", enc_final_vel);
+	}
+
+	compact_clock = clock() - compact_clock - telemetry.take_overhead();
+
+	stringstream compact_stream;
+	compact_stream << enc_final_vel;
+	size_t compact_size = compact_stream.str().size();
+	long capacity = enc_final_vel.bitCapacity();
 
 	//Decrypt
 	clock_t dec_clock;
@@ -120,8 +270,125 @@ int main()
 	ea.decrypt(enc_final_vel, secret_key, final_vel);
 
 	dec_clock = clock() - dec_clock;
+
+	//Streaming
+	//Allocating and in-place paths; see "Allocation-free streaming" in README.md
+	clock_t stream_alloc_clock = 0;
+	clock_t stream_inplace_clock = 0;
+	uint64_t stream_alloc_count = 0;
+	uint64_t stream_inplace_count = 0;
+	bool stream_match = true;
+
+	if(stream_runs > 0)
+	{
+		long result_level = enc_final_vel.findBaseLevel();
+
+		uint64_t allocations = AllocationCounter::count();
+		stream_alloc_clock = clock();
+		for(int run = 0; run < stream_runs; run++)
+		{
+			Ctxt batch_vel(enc_acc);
+			batch_vel *= enc_times;
+			batch_vel += enc_initial_vel;
+			batch_vel.modDownToLevel(result_level);
+		}
+		stream_alloc_clock = clock() - stream_alloc_clock;
+		stream_alloc_count = AllocationCounter::count() - allocations;
+
+		Ctxt stream_vel(public_key);
+		auto evaluate_inplace = [&]()
+		{
+			stream_vel = enc_acc;
+			stream_vel.multiplyBy(enc_times);
+			stream_vel += enc_initial_vel;
+			stream_vel.modDownToLevel(result_level);
+		};
+
+		//The first batch sizes the buffer and is not counted
+		evaluate_inplace();
+
+		allocations = AllocationCounter::count();
+		stream_inplace_clock = clock();
+		for(int run = 0; run < stream_runs; run++)
+			evaluate_inplace();
+		stream_inplace_clock = clock() - stream_inplace_clock;
+		stream_inplace_count = AllocationCounter::count() - allocations;
+
+		vector<long> stream_vel_plain;
+		ea.decrypt(stream_vel, secret_key, stream_vel_plain);
+		stream_match = stream_vel_plain == final_vel;
+	}
+
+	//Incremental updates
+	//Update rounds work on copies of the inputs; see "Incremental updates" in README.md
+	//Ctxt has no default constructor, so the cache holds shared pointers.
+	IncrementalCache<shared_ptr<Ctxt>> cache([](const shared_ptr<Ctxt> &ct)
+	{
+		stringstream bytes;
+		bytes << *ct;
+		return bytes.str().size();
+	});
+	uint64_t acc_version = 0;
+	uint64_t times_version = 0;
+	clock_t update_clock = 0;
+	size_t update_mismatches = 0;
+	Ctxt enc_update_vel(public_key);
+	vector<long> update_initial_velocity(initial_velocity);
+	vector<long> update_times(times);
+	vector<long> update_acc(acc);
+	Ctxt enc_update_initial_vel(enc_initial_vel);
+	Ctxt enc_update_times(enc_times);
+	Ctxt enc_update_acc(enc_acc);
+
+	auto refresh = [&](vector<long> &column, int range, Ctxt &encrypted)
+	{
+		for(int i = 0; i < N; i++)
+			column[i] = rand() % range;
+		ea.encrypt(encrypted, public_key, column);
+	};
+
+	for(int round = 0; round < updates; round++)
+	{
+		refresh(update_initial_velocity, 50, enc_update_initial_vel);
+		if(rand() % 100 < churn)
+		{
+			refresh(update_acc, 25, enc_update_acc);
+			acc_version++;
+		}
+		if(rand() % 100 < churn)
+		{
+			refresh(update_times, 30, enc_update_times);
+			times_version++;
+		}
+
+		clock_t round_clock;
+		round_clock = clock();
+
+		const shared_ptr<Ctxt> &enc_acc_times = cache.get("acc*times", { acc_version, times_version }, [&]()
+		{
+			shared_ptr<Ctxt> product = make_shared<Ctxt>(enc_update_acc);
+			*product *= enc_update_times;
+			return product;
+		});
+		enc_update_vel = *enc_acc_times;
+		enc_update_vel += enc_update_initial_vel;
+
+		update_clock += clock() - round_clock;
+	}
+
+	//Check the last round against the plaintext inputs
+	if(updates > 0)
+	{
+		vector<long> update_vel;
+		ea.decrypt(enc_update_vel, secret_key, update_vel);
+
+		for(int i = 0; i < num_slots; i++)
+			if(update_vel[i] != (update_initial_velocity[i] + update_acc[i] * update_times[i]) % (long)prime_mod)
+				update_mismatches++;
+	}
+
 	/*****Print*****/
-	cout << "Starting the velocity caluculator with " << num_slots << " instances. "<< endl << endl;
+	cout << "Starting the velocity caluculator with " << N << " instances. "<< endl << endl;
 
 	cout << "Acceleration: " << endl;
 	print(acc, num_slots);
@@ -141,6 +408,40 @@ int main()
 	cout << "Encryption            : " << ((float)enc_clock)/CLOCKS_PER_SEC << endl;
 	cout << "Evaluation (v_i + at) : " << ((float)eval_clock)/CLOCKS_PER_SEC << endl;
 	cout << "Decryption            : " << ((float)dec_clock)/CLOCKS_PER_SEC << endl;
-	return 0;
+	cout << "Compaction            : " << ((float)compact_clock)/CLOCKS_PER_SEC << endl;
+	cout << "Result Size (bytes)   : " << full_size << " -> " << compact_size << endl;
+	cout << "Result Capacity       : " << capacity << " bits" << endl;
+	if(stream_runs > 0)
+	{
+		double records = (double)stream_runs * N;
+		cout << "Stream Allocating     : " << ((float)stream_alloc_clock)/CLOCKS_PER_SEC/stream_runs << " per batch, " << stream_alloc_count / records << " allocations per record" << endl;
+		cout << "Stream In-Place       : " << ((float)stream_inplace_clock)/CLOCKS_PER_SEC/stream_runs << " per batch, " << stream_inplace_count / records << " allocations per record" << endl;
+		cout << "Stream Result Matches : " << boolalpha << stream_match << endl;
+	}
+	if(updates > 0)
+	{
+		cout << "Update Evaluation     : " << ((float)update_clock)/CLOCKS_PER_SEC/updates << " per round over " << updates << " rounds" << endl;
+		cout << "Cache Hit Rate        : " << cache.hit_rate() * 100 << "% (" << cache.hits() << " hits, " << cache.misses() << " misses)" << endl;
+		cout << "Cache Memory (bytes)  : " << cache.bytes() << endl;
+		cout << "Update Mismatches     : " << update_mismatches << endl;
+	}
 
+	if(telemetry.enabled())
+	{
+		telemetry.timing("parameter_generation", cc_clock);
+		telemetry.timing("key_generation", key_clock);
+		telemetry.timing("encryption", enc_clock);
+		telemetry.timing("evaluation", eval_clock);
+		telemetry.timing("compaction", compact_clock);
+		telemetry.timing("decryption", dec_clock);
+		telemetry.report(cout);
+		if(!telemetry.write())
+			cerr << "Could not write telemetry file" << endl;
+	}
+
+	bool correct = capacity > 0 && stream_match && update_mismatches == 0;
+	//Exit status 3 tells scripts the result failed its own check
+	if(!correct)
+		return 3;
+	return 0;
 }
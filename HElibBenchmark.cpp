@@ -0,0 +1,234 @@
+/***************************************/
+/* HElib BGV primitive benchmarks      */
+/* Per-operation costs for the         */
+/* velocity calculator building blocks */
+/* Built on Google Benchmark           */
+/***************************************/
+#include <map>
+#include <memory>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <helib/helib.h>
+
+using namespace std;
+using namespace helib;
+
+//Context and keys for one ring dimension. Built once and shared by every
+//benchmark so key generation never shows up in the timings.
+struct HElibSetup
+{
+	unique_ptr<Context> context;
+	unique_ptr<SecKey> secret_key;
+	const EncryptedArray *ea;
+	vector<long> values;
+	string error;
+
+	unique_ptr<Ctxt> fresh()
+	{
+		unique_ptr<Ctxt> encrypted(new Ctxt(*secret_key));
+		ea->encrypt(*encrypted, *secret_key, values);
+		return encrypted;
+	}
+};
+
+//Largest log2(q) the HE standard allows at 128-bit security for a ternary
+//secret; rows are ring dimensions 4096 ... 32768
+static long max_modulus_bits(long n)
+{
+	static const long table[4] = { 109, 218, 438, 881 };
+	for(int row = 0; row < 4; row++)
+		if(n == (4096L << row))
+			return table[row];
+	return -1;
+}
+
+//Power-of-two cyclotomics m = 2n with p = 65537 = 1 mod m, so every ring
+//dimension is fully packed. The chain leaves room for the special primes
+//buildModChain adds, so the whole modulus stays within the 128-bit bound.
+static HElibSetup &helib_setup(long n)
+{
+	static map<long, unique_ptr<HElibSetup> > setups;
+	unique_ptr<HElibSetup> &s = setups[n];
+	if(s)
+		return *s;
+
+	unsigned long prime_mod      = 65537;
+	unsigned long cyc_poly       = 2 * n;
+	unsigned long key_switch_col = 2;
+	unsigned long bits_mod_chain = max_modulus_bits(n) * key_switch_col / (key_switch_col + 1);
+
+	s.reset(new HElibSetup());
+	s->context.reset(new Context(cyc_poly, prime_mod, 1));
+	buildModChain(*s->context, bits_mod_chain, key_switch_col);
+	if(s->context->securityLevel() < 128)
+	{
+		s->error = "ring dimension not available at 128-bit security";
+		return *s;
+	}
+
+	s->secret_key.reset(new SecKey(*s->context));
+	s->secret_key->GenSecKey();
+	addSome1DMatrices(*s->secret_key);
+
+	s->ea = s->context->ea;
+	for(long i = 0; i < s->ea->size(); i++)
+		s->values.push_back(rand() % 30);
+
+	return *s;
+}
+
+//Fetches the setup for this run, or marks the run skipped
+static HElibSetup *setup_or_skip(benchmark::State &state)
+{
+	HElibSetup &s = helib_setup(state.range(0));
+	if(!s.error.empty())
+	{
+		state.SkipWithError(s.error.c_str());
+		return NULL;
+	}
+	return &s;
+}
+
+static void BM_Encode(benchmark::State &state)
+{
+	HElibSetup *s = setup_or_skip(state);
+	if(s == NULL)
+		return;
+	NTL::ZZX encoded;
+	for(auto _ : state)
+		s->ea->encode(encoded, s->values);
+}
+
+static void BM_Encrypt(benchmark::State &state)
+{
+	HElibSetup *s = setup_or_skip(state);
+	if(s == NULL)
+		return;
+	NTL::ZZX encoded;
+	Ctxt encrypted(*s->secret_key);
+	s->ea->encode(encoded, s->values);
+	const PubKey &public_key = *s->secret_key;
+	for(auto _ : state)
+		public_key.Encrypt(encrypted, encoded);
+}
+
+//Tensor product only; relinearization is measured separately
+static void BM_Multiply(benchmark::State &state)
+{
+	HElibSetup *s = setup_or_skip(state);
+	if(s == NULL)
+		return;
+	unique_ptr<Ctxt> a = s->fresh(), b = s->fresh();
+	for(auto _ : state)
+	{
+		state.PauseTiming();
+		Ctxt product(*a);
+		state.ResumeTiming();
+		product.multLowLvl(*b);
+	}
+}
+
+static void BM_Relinearize(benchmark::State &state)
+{
+	HElibSetup *s = setup_or_skip(state);
+	if(s == NULL)
+		return;
+	unique_ptr<Ctxt> a = s->fresh(), b = s->fresh();
+	a->multLowLvl(*b);
+	for(auto _ : state)
+	{
+		state.PauseTiming();
+		Ctxt product(*a);
+		state.ResumeTiming();
+		product.reLinearize();
+	}
+}
+
+static void BM_ModSwitch(benchmark::State &state)
+{
+	HElibSetup *s = setup_or_skip(state);
+	if(s == NULL)
+		return;
+	unique_ptr<Ctxt> a = s->fresh(), b = s->fresh();
+	a->multiplyBy(*b);
+	long level = a->findBaseLevel() - 1;
+	for(auto _ : state)
+	{
+		state.PauseTiming();
+		Ctxt product(*a);
+		state.ResumeTiming();
+		product.modDownToLevel(level);
+	}
+}
+
+static void BM_Add(benchmark::State &state)
+{
+	HElibSetup *s = setup_or_skip(state);
+	if(s == NULL)
+		return;
+	unique_ptr<Ctxt> a = s->fresh(), b = s->fresh();
+	for(auto _ : state)
+	{
+		state.PauseTiming();
+		Ctxt sum(*a);
+		state.ResumeTiming();
+		sum += *b;
+	}
+}
+
+static void BM_Rotate(benchmark::State &state)
+{
+	HElibSetup *s = setup_or_skip(state);
+	if(s == NULL)
+		return;
+	unique_ptr<Ctxt> a = s->fresh();
+	for(auto _ : state)
+	{
+		state.PauseTiming();
+		Ctxt rotated(*a);
+		state.ResumeTiming();
+		s->ea->rotate(rotated, 1);
+	}
+}
+
+static void BM_Decrypt(benchmark::State &state)
+{
+	HElibSetup *s = setup_or_skip(state);
+	if(s == NULL)
+		return;
+	unique_ptr<Ctxt> a = s->fresh();
+	NTL::ZZX decrypted;
+	for(auto _ : state)
+		s->secret_key->Decrypt(decrypted, *a);
+}
+
+static void BM_Decode(benchmark::State &state)
+{
+	HElibSetup *s = setup_or_skip(state);
+	if(s == NULL)
+		return;
+	unique_ptr<Ctxt> a = s->fresh();
+	NTL::ZZX decrypted;
+	vector<long> decoded;
+	s->secret_key->Decrypt(decrypted, *a);
+	for(auto _ : state)
+		s->ea->decode(decoded, decrypted);
+}
+
+//Ring dimensions 4096 through 32768
+#define HELIB_BENCHMARK(fn) \
+	BENCHMARK(fn)->RangeMultiplier(2)->Range(4096, 32768)->Unit(benchmark::kMicrosecond)
+
+HELIB_BENCHMARK(BM_Encode);
+HELIB_BENCHMARK(BM_Encrypt);
+HELIB_BENCHMARK(BM_Multiply);
+HELIB_BENCHMARK(BM_Relinearize);
+HELIB_BENCHMARK(BM_ModSwitch);
+HELIB_BENCHMARK(BM_Add);
+HELIB_BENCHMARK(BM_Rotate);
+HELIB_BENCHMARK(BM_Decrypt);
+HELIB_BENCHMARK(BM_Decode);
+
+BENCHMARK_MAIN();
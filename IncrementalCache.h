@@ -0,0 +1,87 @@
+/****************************************/
+/* Incremental recomputation cache      */
+/* Memoizes intermediate ciphertexts by */
+/* the versions of the inputs they were */
+/* computed from                        */
+/****************************************/
+
+#ifndef INCREMENTAL_CACHE_H
+#define INCREMENTAL_CACHE_H
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+//Ct is the library's ciphertext handle. measure returns the bytes one cached
+//ciphertext occupies, so the cache can report its memory overhead.
+template <typename Ct>
+class IncrementalCache
+{
+public:
+	explicit IncrementalCache(std::function<size_t(const Ct &)> measure)
+		: measure_(measure), hits_(0), misses_(0), bytes_(0)
+	{
+	}
+
+	//Returns the node's cached value if it was computed from exactly these
+	//input versions, otherwise runs compute and caches the new value
+	template <typename ComputeFn>
+	const Ct &get(const std::string &node, const std::vector<uint64_t> &input_versions, ComputeFn compute)
+	{
+		typename std::map<std::string, Entry>::iterator it = entries_.find(node);
+		if(it != entries_.end() && it->second.versions == input_versions)
+		{
+			hits_++;
+			return it->second.value;
+		}
+
+		misses_++;
+		Entry &entry = entries_[node];
+		bytes_ -= entry.bytes;
+		entry.versions = input_versions;
+		entry.value = compute();
+		entry.bytes = measure_(entry.value);
+		bytes_ += entry.bytes;
+		return entry.value;
+	}
+
+	uint64_t hits() const
+	{
+		return hits_;
+	}
+
+	uint64_t misses() const
+	{
+		return misses_;
+	}
+
+	double hit_rate() const
+	{
+		return (hits_ + misses_) == 0 ? 0 : (double)hits_ / (hits_ + misses_);
+	}
+
+	size_t bytes() const
+	{
+		return bytes_;
+	}
+
+private:
+	struct Entry
+	{
+		Entry() : bytes(0) {}
+
+		std::vector<uint64_t> versions;
+		Ct value;
+		size_t bytes;
+	};
+
+	std::function<size_t(const Ct &)> measure_;
+	std::map<std::string, Entry> entries_;
+	uint64_t hits_;
+	uint64_t misses_;
+	size_t bytes_;
+};
+
+#endif
@@ -7,7 +7,19 @@
 /***************************************/
 
 #include "palisade.h"
+#include "ciphertext-ser.h"
+#include "cryptocontext-ser.h"
+#include "pubkeylp-ser.h"
+#include "scheme/bfvrns/bfvrns-ser.h"
+#include "EncryptedStore.h"
+#include "IncrementalCache.h"
+#include "FixedPoint.h"
+#include "AllocationCounter.h"
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string.h>
 #include <vector>
 #include <time.h>
 #include <stdlib.h>
@@ -38,7 +50,31 @@ void print(Plaintext v, int length)
     cout << endl;
 }
 
-int main()
+void print(vector<double> v, int length)
+{
+
+    int print_size = 20;
+    int end_size = 2;
+
+    cout << endl;
+    cout << "    [";
+
+    for (int i = 0; i < print_size; i++)
+    {
+        cout << setw(3) << right << v[i] << ",";
+    }
+
+    cout << setw(3) << " ...,";
+
+    for (int i = length - end_size; i < length; i++)
+    {
+        cout << setw(3) << v[i] << ((i != length - 1) ? "," : " ]\n");
+    }
+    
+    cout << endl;
+}
+
+int main(int argc, char *argv[])
 {
 	//Check to see if BFVrns is available
 	#ifdef NO_QUADMATH
@@ -47,18 +83,164 @@ int main()
 	#endif
 	srand(time(NULL));
 
+	//--store <path> keeps the encrypted columns and keys on disk. The first
+	//run encrypts and writes them, later runs evaluate the stored columns.
+	//--updates R then runs R incremental update rounds in which acceleration
+	//and time each change with probability --churn percent.
+	//--fixed-point F runs on real-valued inputs encoded with F fractional bits.
+	//--security 128|192|256, --ring-dim D and --n N select the configuration.
+	//Without --ring-dim PALISADE picks the smallest secure ring dimension.
+	//--stream R re-evaluates the inputs R times and counts heap allocations.
+	string store_path;
+	int updates = 0;
+	int churn = 5;
+	int frac_bits = 0;
+	int security = 128;
+	uint32_t ring_dim = 0;
+	int N = 2760;
+	bool n_given = false;
+	int stream_runs = 0;
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "--store") == 0 && i + 1 < argc)
+			store_path = argv[++i];
+		else if(strcmp(argv[i], "--updates") == 0 && i + 1 < argc)
+			updates = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--churn") == 0 && i + 1 < argc)
+			churn = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--fixed-point") == 0 && i + 1 < argc)
+			frac_bits = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--security") == 0 && i + 1 < argc)
+			security = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--ring-dim") == 0 && i + 1 < argc)
+			ring_dim = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--n") == 0 && i + 1 < argc)
+		{
+			N = atoi(argv[++i]);
+			n_given = true;
+		}
+		else if(strcmp(argv[i], "--stream") == 0 && i + 1 < argc)
+			stream_runs = atoi(argv[++i]);
+	}
+	SecurityLevel securityLevel;
+	if(security == 128)
+		securityLevel = HEStd_128_classic;
+	else if(security == 192)
+		securityLevel = HEStd_192_classic;
+	else if(security == 256)
+		securityLevel = HEStd_256_classic;
+	else
+	{
+		cerr << "--security must be 128, 192 or 256" << endl;
+		return 2;
+	}
+	bool use_store = !store_path.empty();
+	bool store_loaded = use_store && EncryptedStore::exists(store_path);
+
+	//An existing store fixes the number of records it was written with
+	if(store_loaded)
+	{
+		uint64_t stored_n = EncryptedStore(store_path).attribute("records", N);
+		if(n_given && (uint64_t)N != stored_n)
+		{
+			cerr << "--n " << N << " conflicts with the " << stored_n << " records in store " << store_path << endl;
+			return 2;
+		}
+		N = stored_n;
+	}
+
+	//Fixed point: a and t are encoded at 2^F, so a*t and v_i live at 2^2F and
+	//the plaintext modulus must hold |v_i + at| <= 50 + 25*30 at that scale
+	bool fixed_point = frac_bits > 0;
+	FixedPointCodec codec(frac_bits);
+	int result_scale = FixedPointCodec::product_scale(codec.input_scale(), codec.input_scale());
+	int plain_modulus_bits = FixedPointCodec::plain_modulus_bits(50 + 25*30, result_scale);
+	if(fixed_point && (use_store || updates > 0))
+	{
+		cerr << "--fixed-point cannot be combined with --store or --updates" << endl;
+		return 2;
+	}
+	if(fixed_point && plain_modulus_bits > 60)
+	{
+		cerr << "--fixed-point " << frac_bits << " needs a " << plain_modulus_bits << "-bit plaintext modulus; BFVrns allows at most 60" << endl;
+		return 2;
+	}
+
+	//The context and keys live next to the store so stored ciphertexts stay decryptable
+	fstream key_file;
+	if(use_store)
+		key_file.open((store_path + ".keys").c_str(), ios::binary | (store_loaded ? ios::in : ios::out | ios::trunc));
+
 	/*****Set up the CryptoContext*****/
 	clock_t cc_clock;
 	cc_clock = clock();
 	//Parameter Selection based on standard parameters from HE standardization workshop
-  int plaintextModulus = 536903681;
+  PlaintextModulus plaintextModulus = 536903681;
+	//Packing needs p = 1 mod 2n. The default prime is only 1 mod 2^14, so an
+	//explicit --ring-dim or fixed point searches for a prime of the needed
+	//width; 2^16 covers every ring dimension PALISADE picks on its own.
+	//FirstPrime searches upwards from 2^bits, so start one bit lower.
+	if(fixed_point || ring_dim != 0)
+	{
+		int bits = fixed_point ? plain_modulus_bits : 30;
+		NativeInteger prime;
+		try
+		{
+			prime = FirstPrime<NativeInteger>(bits - 1, ring_dim != 0 ? 2 * ring_dim : 65536);
+		}
+		catch(const std::exception &e)
+		{
+			cerr << "No " << bits << "-bit packing plaintext modulus for ring dimension " << ring_dim << ": " << e.what() << endl;
+			return 2;
+		}
+		if(prime.GetMSB() > 60)
+		{
+			cerr << "--fixed-point " << frac_bits << " needs a " << prime.GetMSB() << "-bit plaintext modulus; BFVrns allows at most 60" << endl;
+			return 2;
+		}
+		plaintextModulus = prime.ConvertToInt();
+	}
 	double sigma = 3.2;
-	SecurityLevel securityLevel = HEStd_128_classic;
 	uint32_t depth = 2;
 
 
 	//Create the cryptoContext with the desired parameters
-	CryptoContext<DCRTPoly> cryptoContext = CryptoContextFactory<DCRTPoly>::genCryptoContextBFVrns(plaintextModulus, securityLevel, sigma, 0, depth, 0, OPTIMIZED);
+	CryptoContext<DCRTPoly> cryptoContext;
+	if(store_loaded)
+	{
+		CryptoContextFactory<DCRTPoly>::ReleaseAllContexts();
+		Serial::Deserialize(cryptoContext, key_file, SerType::BINARY);
+		if(ring_dim != 0 && ring_dim != cryptoContext->GetRingDimension())
+		{
+			cerr << "--ring-dim " << ring_dim << " conflicts with ring dimension " << cryptoContext->GetRingDimension() << " in store " << store_path << endl;
+			return 2;
+		}
+	}
+	else
+	{
+		//PALISADE rejects a ring dimension too small for the security level
+		try
+		{
+			cryptoContext = CryptoContextFactory<DCRTPoly>::genCryptoContextBFVrns(plaintextModulus, securityLevel, sigma, 0, depth, 0, OPTIMIZED, 2, 0, 60, ring_dim);
+		}
+		catch(const std::exception &e)
+		{
+			cerr << "No valid parameters for ring dimension " << ring_dim << " at " << security << "-bit security: " << e.what() << endl;
+			return 2;
+		}
+	}
+	if(N < 0 || (uint32_t)N > cryptoContext->GetRingDimension())
+	{
+		cerr << "--n " << N << " does not fit in " << cryptoContext->GetRingDimension() << " slots" << endl;
+		return 2;
+	}
+	//MakePackedPlaintext throws unless p = 1 mod 2n for the ring PALISADE chose
+	PlaintextModulus packing_modulus = cryptoContext->GetCryptoParameters()->GetPlaintextModulus();
+	if((packing_modulus - 1) % (2 * cryptoContext->GetRingDimension()) != 0)
+	{
+		cerr << "Plaintext modulus " << packing_modulus << " does not support packing at ring dimension " << cryptoContext->GetRingDimension() << endl;
+		return 2;
+	}
 
 	//Enable wanted functions
 	cryptoContext->Enable(ENCRYPTION);
@@ -73,11 +255,28 @@ int main()
 	//Create the container for the public key   
 	LPKeyPair<DCRTPoly> keyPair;
 
-	//Generate the keyPair
-	keyPair = cryptoContext->KeyGen();
-
-	//Generate the relinearization key
-	cryptoContext->EvalMultKeyGen(keyPair.secretKey);
+	if(store_loaded)
+	{
+		Serial::Deserialize(keyPair.publicKey, key_file, SerType::BINARY);
+		Serial::Deserialize(keyPair.secretKey, key_file, SerType::BINARY);
+		cryptoContext->DeserializeEvalMultKey(key_file, SerType::BINARY);
+	}
+	else
+	{
+		//Generate the keyPair
+		keyPair = cryptoContext->KeyGen();
+
+		//Generate the relinearization key
+		cryptoContext->EvalMultKeyGen(keyPair.secretKey);
+
+		if(use_store)
+		{
+			Serial::Serialize(cryptoContext, key_file, SerType::BINARY);
+			Serial::Serialize(keyPair.publicKey, key_file, SerType::BINARY);
+			Serial::Serialize(keyPair.secretKey, key_file, SerType::BINARY);
+			cryptoContext->SerializeEvalMultKey(key_file, SerType::BINARY);
+		}
+	}
 
 	key_clock = clock() - key_clock;
 
@@ -85,34 +284,93 @@ int main()
 	clock_t enc_clock;
 	enc_clock = clock();
 
-	//Create and encode the plaintext vectors and variables
-	int N = 2760; 
+	clock_t store_clock = 0;
+
+	//Create and encode the plaintext vectors and variables 
 	vector<int64_t> initial_velocity; 
 	vector<int64_t> times; 
 	vector<int64_t> acc;   
+	vector<double> initial_velocity_real;
+	vector<double> times_real;
+	vector<double> acc_real;
 
-	for(int i = 0; i < N; i++)
-	{
-		int64_t a = rand() % 25;
-		acc.push_back(a);
+	Plaintext plain_acc;
+	Plaintext plain_initial_vel;
+	Plaintext plain_times;
 
-		int64_t b = rand() % 50;
-		initial_velocity.push_back(b);
+	Ciphertext<DCRTPoly> enc_acc;
+	Ciphertext<DCRTPoly> enc_initial_vel;
+	Ciphertext<DCRTPoly> enc_times;
 
-		int64_t c = rand() % 30;
-		times.push_back(c);
-	}
+	if(store_loaded)
+	{
+		/*****Load stored columns*****/
+		store_clock = clock();
 
-	Plaintext plain_acc = cryptoContext->MakePackedPlaintext(acc);
-	Plaintext plain_initial_vel = cryptoContext->MakePackedPlaintext(initial_velocity);
-	Plaintext plain_times = cryptoContext->MakePackedPlaintext(times);
+		EncryptedStore store(store_path);
+		store.load("acc", 0, [&](istream &in) { Serial::Deserialize(enc_acc, in, SerType::BINARY); });
+		store.load("initial_velocity", 0, [&](istream &in) { Serial::Deserialize(enc_initial_vel, in, SerType::BINARY); });
+		store.load("times", 0, [&](istream &in) { Serial::Deserialize(enc_times, in, SerType::BINARY); });
 
-	//Encrypt the encodings
-	auto enc_acc = cryptoContext->Encrypt(keyPair.publicKey, plain_acc);
-	auto enc_initial_vel = cryptoContext->Encrypt(keyPair.publicKey, plain_initial_vel);
-	auto enc_times = cryptoContext->Encrypt(keyPair.publicKey, plain_times);
+		store_clock = clock() - store_clock;
+	}
+	else
+	{
+		for(int i = 0; i < N; i++)
+		{
+			if(fixed_point)
+			{
+				acc_real.push_back(rand()/(double(RAND_MAX))*25);
+				initial_velocity_real.push_back(rand()/(double(RAND_MAX))*50);
+				times_real.push_back(rand()/(double(RAND_MAX))*30);
+				continue;
+			}
+
+			int64_t a = rand() % 25;
+			acc.push_back(a);
+
+			int64_t b = rand() % 50;
+			initial_velocity.push_back(b);
+
+			int64_t c = rand() % 30;
+			times.push_back(c);
+		}
+
+		if(fixed_point)
+		{
+			acc = codec.encode(acc_real, codec.input_scale());
+			initial_velocity = codec.encode(initial_velocity_real, result_scale);
+			times = codec.encode(times_real, codec.input_scale());
+		}
+
+		plain_acc = cryptoContext->MakePackedPlaintext(acc);
+		plain_initial_vel = cryptoContext->MakePackedPlaintext(initial_velocity);
+		plain_times = cryptoContext->MakePackedPlaintext(times);
+
+		//Encrypt the encodings
+		enc_acc = cryptoContext->Encrypt(keyPair.publicKey, plain_acc);
+		enc_initial_vel = cryptoContext->Encrypt(keyPair.publicKey, plain_initial_vel);
+		enc_times = cryptoContext->Encrypt(keyPair.publicKey, plain_times);
+
+		if(use_store)
+		{
+			/*****Store columns*****/
+			store_clock = clock();
+
+			EncryptedStoreWriter writer(store_path);
+			writer.set_attribute("records", N);
+			Serial::Serialize(enc_acc, writer.begin_chunk("acc", 0), SerType::BINARY);
+			writer.end_chunk();
+			Serial::Serialize(enc_initial_vel, writer.begin_chunk("initial_velocity", 0), SerType::BINARY);
+			writer.end_chunk();
+			Serial::Serialize(enc_times, writer.begin_chunk("times", 0), SerType::BINARY);
+			writer.end_chunk();
+
+			store_clock = clock() - store_clock;
+		}
+	}
 
-	enc_clock = clock() - enc_clock;
+	enc_clock = clock() - enc_clock - store_clock;
 
 	/*****Evaluation*****/
   clock_t eval_clock;
@@ -123,6 +381,13 @@ int main()
 
 	eval_clock = clock() - eval_clock;
 
+	/*****Result size*****/
+	//BFVrns has no modulus switching in PALISADE (ModReduce/Compress are only
+	//implemented for CKKS and BGVrns), so the result keeps every tower
+	stringstream result_stream;
+	Serial::Serialize(enc_final_vel, result_stream, SerType::BINARY);
+	size_t result_size = result_stream.str().size();
+
 	/*****Decryption*****/
 	clock_t dec_clock;
 	dec_clock = clock();
@@ -132,20 +397,148 @@ int main()
 
 	dec_clock = clock() - dec_clock;
 
+	/*****Streaming*****/
+	//EvalMult plus EvalAddInPlace; see "Allocation-free streaming" in README.md
+	clock_t stream_clock = 0;
+	uint64_t stream_mult_count = 0;
+	uint64_t stream_add_count = 0;
+	bool stream_match = true;
+
+	if(stream_runs > 0)
+	{
+		//The product is the batch result, so the add reuses it
+		Ciphertext<DCRTPoly> stream_vel;
+		stream_clock = clock();
+		for(int run = 0; run < stream_runs; run++)
+		{
+			uint64_t allocations = AllocationCounter::count();
+			stream_vel = cryptoContext->EvalMult(enc_acc, enc_times);
+			uint64_t mult_allocations = AllocationCounter::count();
+			cryptoContext->EvalAddInPlace(stream_vel, enc_initial_vel);
+			stream_mult_count += mult_allocations - allocations;
+			stream_add_count += AllocationCounter::count() - mult_allocations;
+		}
+		stream_clock = clock() - stream_clock;
+
+		Plaintext plain_stream_vel;
+		cryptoContext->Decrypt(keyPair.secretKey, stream_vel, &plain_stream_vel);
+		stream_match = plain_stream_vel->GetPackedValue() == plain_final_velocity->GetPackedValue();
+	}
+
+	/*****Incremental updates*****/
+	//Update rounds; see "Incremental updates" in README.md
+	IncrementalCache<Ciphertext<DCRTPoly>> cache([](const Ciphertext<DCRTPoly> &ct)
+	{
+		stringstream bytes;
+		Serial::Serialize(ct, bytes, SerType::BINARY);
+		return bytes.str().size();
+	});
+	uint64_t acc_version = 0;
+	uint64_t times_version = 0;
+	bool acc_known = !store_loaded;
+	bool times_known = !store_loaded;
+	clock_t update_clock = 0;
+	size_t update_mismatches = 0;
+	Ciphertext<DCRTPoly> enc_update_vel;
+
+	auto refresh = [&](vector<int64_t> &column, int range)
+	{
+		column.clear();
+		for(int i = 0; i < N; i++)
+			column.push_back(rand() % range);
+
+		Plaintext plain = cryptoContext->MakePackedPlaintext(column);
+		return cryptoContext->Encrypt(keyPair.publicKey, plain);
+	};
+
+	for(int round = 0; round < updates; round++)
+	{
+		enc_initial_vel = refresh(initial_velocity, 50);
+		if(rand() % 100 < churn)
+		{
+			enc_acc = refresh(acc, 25);
+			acc_version++;
+			acc_known = true;
+		}
+		if(rand() % 100 < churn)
+		{
+			enc_times = refresh(times, 30);
+			times_version++;
+			times_known = true;
+		}
+
+		clock_t round_clock;
+		round_clock = clock();
+
+		auto enc_acc_mult_times = cache.get("acc*times", { acc_version, times_version }, [&]()
+		{
+			return cryptoContext->EvalMult(enc_acc, enc_times);
+		});
+		enc_update_vel = cryptoContext->EvalAdd(enc_initial_vel, enc_acc_mult_times);
+
+		update_clock += clock() - round_clock;
+	}
+
+	//Check the last round against the plaintext inputs, when they are known
+	if(updates > 0 && acc_known && times_known)
+	{
+		Plaintext plain_update_vel;
+		cryptoContext->Decrypt(keyPair.secretKey, enc_update_vel, &plain_update_vel);
+
+		for(int i = 0; i < N; i++)
+			if(plain_update_vel->GetPackedValue()[i] != initial_velocity[i] + acc[i] * times[i])
+				update_mismatches++;
+	}
+
+	//Decode fixed-point results and compare with the exact real-valued result
+	vector<double> final_vel_real;
+	double max_error = 0;
+	if(fixed_point)
+	{
+		vector<int64_t> final_vel_fixed = plain_final_velocity->GetPackedValue();
+		final_vel_fixed.resize(N);
+		final_vel_real = codec.decode(final_vel_fixed, result_scale);
+
+		for(int i = 0; i < N; i++)
+			max_error = max(max_error, fabs(final_vel_real[i] - (initial_velocity_real[i] + acc_real[i] * times_real[i])));
+	}
+
 	/*****Print*****/
 	cout << "Starting the velocity caluculator with " << N << " instances. "<< endl << endl;
 
-	cout << "Acceleration: " << endl;
-	print(plain_acc, N);
+	if(store_loaded)
+	{
+		cout << "Inputs loaded from encrypted store " << store_path << endl << endl;
+	}
+	else if(fixed_point)
+	{
+		cout << "Fixed point with " << frac_bits << " fractional bits, plaintext modulus " << plaintextModulus << " (" << NativeInteger(plaintextModulus).GetMSB() << " bits)" << endl << endl;
+		cout << "Acceleration: " << endl;
+		print(acc_real, N);
+
+		cout << "Initial Velocity: " << endl;
+		print(initial_velocity_real, N);
+
+		cout << "Time: " << endl;
+		print(times_real, N);
+	}
+	else
+	{
+		cout << "Acceleration: " << endl;
+		print(plain_acc, N);
 
-	cout << "Initial Velocity: " << endl;
-	print(plain_initial_vel, N);
+		cout << "Initial Velocity: " << endl;
+		print(plain_initial_vel, N);
 
-	cout << "Time: " << endl;
-	print(plain_times, N);
+		cout << "Time: " << endl;
+		print(plain_times, N);
+	}
 
 	cout << " Final Velocity: " << endl;
-	print(plain_final_velocity, N);
+	if(fixed_point)
+		print(final_vel_real, N);
+	else
+		print(plain_final_velocity, N);
 
 	cout << "Times:" <<endl;
 	cout << "Parameter Generation  : " << ((float)cc_clock)/CLOCKS_PER_SEC << endl;
@@ -153,5 +546,33 @@ int main()
 	cout << "Encryption            : " << ((float)enc_clock)/CLOCKS_PER_SEC << endl;
 	cout << "Evaluation (v_i + at) : " << ((float)eval_clock)/CLOCKS_PER_SEC << endl;
 	cout << "Decryption            : " << ((float)dec_clock)/CLOCKS_PER_SEC << endl;
+	cout << "Result Size (bytes)   : " << result_size << endl;
+	if(fixed_point)
+		cout << "Max Absolute Error    : " << max_error << endl;
+	if(use_store)
+		cout << (store_loaded ? "Store Load            : " : "Store Write           : ") << ((float)store_clock)/CLOCKS_PER_SEC << endl;
+	if(stream_runs > 0)
+	{
+		double records = (double)stream_runs * N;
+		cout << "Stream Evaluation     : " << ((float)stream_clock)/CLOCKS_PER_SEC/stream_runs << " per batch" << endl;
+		cout << "Stream EvalMult       : " << stream_mult_count / records << " allocations per record" << endl;
+		cout << "Stream EvalAddInPlace : " << stream_add_count / records << " allocations per record" << endl;
+		cout << "Stream Result Matches : " << boolalpha << stream_match << endl;
+	}
+	if(updates > 0)
+	{
+		cout << "Update Evaluation     : " << ((float)update_clock)/CLOCKS_PER_SEC/updates << " per round over " << updates << " rounds" << endl;
+		cout << "Cache Hit Rate        : " << cache.hit_rate() * 100 << "% (" << cache.hits() << " hits, " << cache.misses() << " misses)" << endl;
+		cout << "Cache Memory (bytes)  : " << cache.bytes() << endl;
+		if(acc_known && times_known)
+			cout << "Update Mismatches     : " << update_mismatches << endl;
+	}
+
+	bool correct = stream_match && update_mismatches == 0;
+	if(fixed_point && max_error > codec.rounding_error(25, 30))
+		correct = false;
+	//Exit status 3 tells scripts the result failed its own check
+	if(!correct)
+		return 3;
 	return 0;
 }
@@ -7,20 +7,44 @@
 /***************************************/
 
 #include "palisade.h"
+#include "ciphertext-ser.h"
+#include "cryptocontext-ser.h"
+#include "pubkeylp-ser.h"
+#include "scheme/bgv/bgv-ser.h"
+#include "EncryptedStore.h"
 #include <iostream>
 #include <vector>
 #include <time.h>
 #include <stdlib.h>
 #include <fstream>
+#include <sstream>
 #include <random>
 #include <iterator>
+#include <string>
+#include <string.h>
 
 
 using namespace std;
 using namespace lbcrypto;
 
-int main()
+int main(int argc, char *argv[])
 {
+	//--store <path> keeps the encrypted columns and keys on disk. The first
+	//run encrypts and writes them, later runs evaluate the stored columns.
+	string store_path;
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "--store") == 0 && i + 1 < argc)
+			store_path = argv[++i];
+	}
+	bool use_store = !store_path.empty();
+	bool store_loaded = use_store && EncryptedStore::exists(store_path);
+
+	//The context and keys live next to the store so stored ciphertexts stay decryptable
+	fstream key_file;
+	if(use_store)
+		key_file.open((store_path + ".keys").c_str(), ios::binary | (store_loaded ? ios::in : ios::out | ios::trunc));
+
 	/*****Parameter Generation*****/
 	clock_t cc_clock;
 	cc_clock = clock();
@@ -46,7 +70,16 @@ int main()
 
 	PackedEncoding::SetParams(m, encodingParams);
 
-	CryptoContext<Poly> cc = CryptoContextFactory<Poly>::genCryptoContextBGV(params, encodingParams, 11, stdDev);
+	CryptoContext<Poly> cc;
+	if(store_loaded)
+	{
+		CryptoContextFactory<Poly>::ReleaseAllContexts();
+		Serial::Deserialize(cc, key_file, SerType::BINARY);
+	}
+	else
+	{
+		cc = CryptoContextFactory<Poly>::genCryptoContextBGV(params, encodingParams, 11, stdDev);
+	}
 
 	cc->Enable(ENCRYPTION);
 	cc->Enable(SHE);
@@ -57,9 +90,29 @@ int main()
 	clock_t key_clock;
 	key_clock = clock();
 
-	LPKeyPair<Poly> kp = cc->KeyGen();
-	cc->EvalSumKeyGen(kp.secretKey);
-	cc->EvalMultKeyGen(kp.secretKey);
+	LPKeyPair<Poly> kp;
+	if(store_loaded)
+	{
+		Serial::Deserialize(kp.publicKey, key_file, SerType::BINARY);
+		Serial::Deserialize(kp.secretKey, key_file, SerType::BINARY);
+		cc->DeserializeEvalSumKey(key_file, SerType::BINARY);
+		cc->DeserializeEvalMultKey(key_file, SerType::BINARY);
+	}
+	else
+	{
+		kp = cc->KeyGen();
+		cc->EvalSumKeyGen(kp.secretKey);
+		cc->EvalMultKeyGen(kp.secretKey);
+
+		if(use_store)
+		{
+			Serial::Serialize(cc, key_file, SerType::BINARY);
+			Serial::Serialize(kp.publicKey, key_file, SerType::BINARY);
+			Serial::Serialize(kp.secretKey, key_file, SerType::BINARY);
+			cc->SerializeEvalSumKey(key_file, SerType::BINARY);
+			cc->SerializeEvalMultKey(key_file, SerType::BINARY);
+		}
+	}
 
 	key_clock = clock() - key_clock;
 
@@ -67,26 +120,65 @@ int main()
 	clock_t enc_clock;
 	enc_clock = clock();
 
-	std::vector<int64_t> initial_velocity = { 1,2,3,4,5,6,7,8};
-	Plaintext plain_initial_vel = cc->MakePackedPlaintext(initial_velocity);
+	clock_t store_clock = 0;
+
+	Ciphertext<Poly> enc_initial_vel;
+	Ciphertext<Poly> enc_times;
+	Ciphertext<Poly> enc_acc;
+
+	if(store_loaded)
+	{
+		/*****Load stored columns*****/
+		store_clock = clock();
+
+		EncryptedStore store(store_path);
+		store.load("initial_velocity", 0, [&](istream &in) { Serial::Deserialize(enc_initial_vel, in, SerType::BINARY); });
+		store.load("times", 0, [&](istream &in) { Serial::Deserialize(enc_times, in, SerType::BINARY); });
+		store.load("acc", 0, [&](istream &in) { Serial::Deserialize(enc_acc, in, SerType::BINARY); });
+
+		store_clock = clock() - store_clock;
+
+		std::cout << "Inputs loaded from encrypted store " << store_path << std::endl;
+	}
+	else
+	{
+		std::vector<int64_t> initial_velocity = { 1,2,3,4,5,6,7,8};
+		Plaintext plain_initial_vel = cc->MakePackedPlaintext(initial_velocity);
 
-	std::cout << "Initial Velocity \n\t" << initial_velocity << std::endl;
+		std::cout << "Initial Velocity \n\t" << initial_velocity << std::endl;
 
-	std::vector<int64_t> times = { 10, 14, 24, 23, 18, 9, 13, 7};
-	Plaintext plain_times = cc->MakePackedPlaintext(times);
+		std::vector<int64_t> times = { 10, 14, 24, 23, 18, 9, 13, 7};
+		Plaintext plain_times = cc->MakePackedPlaintext(times);
 
-	std::cout << "Times \n\t" << times << std::endl;
+		std::cout << "Times \n\t" << times << std::endl;
 
-	std::vector<int64_t> acc = { 1,2,3,2,1,2,1,2};
-	Plaintext plain_acc = cc->MakePackedPlaintext(acc);
+		std::vector<int64_t> acc = { 1,2,3,2,1,2,1,2};
+		Plaintext plain_acc = cc->MakePackedPlaintext(acc);
 
-	std::cout << "Acceleration \n\t" << acc << std::endl;
+		std::cout << "Acceleration \n\t" << acc << std::endl;
 
-	auto enc_initial_vel = cc->Encrypt(kp.publicKey, plain_initial_vel);
-	auto enc_times = cc->Encrypt(kp.publicKey, plain_times);
-	auto enc_acc = cc->Encrypt(kp.publicKey, plain_acc);
+		enc_initial_vel = cc->Encrypt(kp.publicKey, plain_initial_vel);
+		enc_times = cc->Encrypt(kp.publicKey, plain_times);
+		enc_acc = cc->Encrypt(kp.publicKey, plain_acc);
 
-	enc_clock = clock() - enc_clock;
+		if(use_store)
+		{
+			/*****Store columns*****/
+			store_clock = clock();
+
+			EncryptedStoreWriter writer(store_path);
+			Serial::Serialize(enc_initial_vel, writer.begin_chunk("initial_velocity", 0), SerType::BINARY);
+			writer.end_chunk();
+			Serial::Serialize(enc_times, writer.begin_chunk("times", 0), SerType::BINARY);
+			writer.end_chunk();
+			Serial::Serialize(enc_acc, writer.begin_chunk("acc", 0), SerType::BINARY);
+			writer.end_chunk();
+
+			store_clock = clock() - store_clock;
+		}
+	}
+
+	enc_clock = clock() - enc_clock - store_clock;
 
 	/*****Evaluate*****/
 	clock_t eval_clock;
@@ -96,7 +188,14 @@ int main()
 	enc_final_vel = cc->EvalAdd(enc_final_vel, enc_initial_vel);
 	
 	eval_clock = clock() - eval_clock;
-	
+
+	/*****Result size*****/
+	//The Poly BGV context has a single ciphertext modulus, so there is no
+	//smaller modulus to switch the result down to
+	stringstream result_stream;
+	Serial::Serialize(enc_final_vel, result_stream, SerType::BINARY);
+	size_t result_size = result_stream.str().size();
+
 	/*****Decrypt*****/
 	clock_t dec_clock;
 	dec_clock = clock();
@@ -116,6 +215,9 @@ int main()
 	cout << "Encryption            : " << ((float)enc_clock)/CLOCKS_PER_SEC << endl;
 	cout << "Evaluation (v_i + at) : " << ((float)eval_clock)/CLOCKS_PER_SEC << endl;
 	cout << "Decryption            : " << ((float)dec_clock)/CLOCKS_PER_SEC << endl;
+	cout << "Result Size (bytes)   : " << result_size << endl;
+	if(use_store)
+		cout << (store_loaded ? "Store Load            : " : "Store Write           : ") << ((float)store_clock)/CLOCKS_PER_SEC << endl;
 
 }
 
@@ -0,0 +1,299 @@
+/***************************************/
+/* PALISADE primitive benchmarks       */
+/* BFVrns, CKKS and BGVrns per-op      */
+/* costs for the velocity calculators  */
+/* Built on Google Benchmark           */
+/***************************************/
+
+#include "palisade.h"
+#include <benchmark/benchmark.h>
+#include <map>
+#include <memory>
+#include <stdlib.h>
+#include <utility>
+#include <vector>
+using namespace std;
+using namespace lbcrypto;
+
+enum PalisadeScheme { BFVRNS, CKKS, BGVRNS };
+
+//Context, keys and inputs for one (scheme, ring dimension) pair. Built once
+//and shared by every benchmark so key generation never shows up in the timings.
+struct PalisadeSetup
+{
+	PalisadeScheme scheme;
+	CryptoContext<DCRTPoly> cc;
+	LPKeyPair<DCRTPoly> keys;
+	vector<int64_t> int_values;
+	vector<complex<double>> real_values;
+	string error;
+
+	Plaintext encode()
+	{
+		if(scheme == CKKS)
+			return cc->MakeCKKSPackedPlaintext(real_values);
+		return cc->MakePackedPlaintext(int_values);
+	}
+
+	Ciphertext<DCRTPoly> fresh()
+	{
+		return cc->Encrypt(keys.publicKey, encode());
+	}
+};
+
+//The ring dimension is passed as a request; PALISADE refuses dimensions too
+//small for 128-bit security at the circuit's depth, and those cases are
+//reported as skipped rather than silently run at a larger dimension
+static PalisadeSetup &palisade_setup(PalisadeScheme scheme, usint n)
+{
+	static map<pair<int, usint>, unique_ptr<PalisadeSetup> > setups;
+	unique_ptr<PalisadeSetup> &s = setups[make_pair(static_cast<int>(scheme), n)];
+	if(s)
+		return *s;
+
+	s.reset(new PalisadeSetup());
+	s->scheme = scheme;
+
+	try
+	{
+		PlaintextModulus plaintextModulus = 65537;
+		SecurityLevel securityLevel = HEStd_128_classic;
+
+		if(scheme == BFVRNS)
+			s->cc = CryptoContextFactory<DCRTPoly>::genCryptoContextBFVrns(plaintextModulus, securityLevel, 3.2, 0, 1, 0, OPTIMIZED, 2, 0, 60, n);
+		else if(scheme == CKKS)
+			s->cc = CryptoContextFactory<DCRTPoly>::genCryptoContextCKKS(2, 40, n / 2, securityLevel, n, APPROXRESCALE);
+		else
+			s->cc = CryptoContextFactory<DCRTPoly>::genCryptoContextBGVrns(2, plaintextModulus, securityLevel, 3.2, 2, OPTIMIZED, HYBRID, n);
+
+		s->cc->Enable(ENCRYPTION);
+		s->cc->Enable(SHE);
+		s->cc->Enable(LEVELEDSHE);
+
+		if(s->cc->GetRingDimension() != n)
+		{
+			s->error = "ring dimension not available at 128-bit security";
+			return *s;
+		}
+
+		s->keys = s->cc->KeyGen();
+		s->cc->EvalMultKeyGen(s->keys.secretKey);
+		s->cc->EvalAtIndexKeyGen(s->keys.secretKey, { 1 });
+
+		usint slots = (scheme == CKKS) ? n / 2 : n;
+		for(usint i = 0; i < slots; i++)
+		{
+			s->int_values.push_back(rand() % 30);
+			s->real_values.push_back(rand()/(double(RAND_MAX))*30);
+		}
+	}
+	catch(const exception &e)
+	{
+		s->error = e.what();
+	}
+
+	return *s;
+}
+
+//Fetches the setup for this run, or marks the run skipped
+static PalisadeSetup *setup_or_skip(PalisadeScheme scheme, benchmark::State &state)
+{
+	PalisadeSetup &s = palisade_setup(scheme, state.range(0));
+	if(!s.error.empty())
+	{
+		state.SkipWithError(s.error.c_str());
+		return NULL;
+	}
+	state.counters["ring_dim"] = s.cc->GetRingDimension();
+	return &s;
+}
+
+//PALISADE reports unsupported operations by throwing; those runs are
+//reported as skipped rather than aborting the whole binary
+template <typename Body>
+static void run_or_skip(benchmark::State &state, Body body)
+{
+	try
+	{
+		body();
+	}
+	catch(const exception &e)
+	{
+		state.SkipWithError(e.what());
+	}
+}
+
+template <PalisadeScheme Scheme>
+static void BM_Encode(benchmark::State &state)
+{
+	PalisadeSetup *s = setup_or_skip(Scheme, state);
+	if(s == NULL)
+		return;
+	run_or_skip(state, [&]() {
+		for(auto _ : state)
+			benchmark::DoNotOptimize(s->encode());
+	});
+}
+
+template <PalisadeScheme Scheme>
+static void BM_Encrypt(benchmark::State &state)
+{
+	PalisadeSetup *s = setup_or_skip(Scheme, state);
+	if(s == NULL)
+		return;
+	run_or_skip(state, [&]() {
+		Plaintext plain = s->encode();
+		for(auto _ : state)
+			benchmark::DoNotOptimize(s->cc->Encrypt(s->keys.publicKey, plain));
+	});
+}
+
+//Tensor product only; relinearization is measured separately
+template <PalisadeScheme Scheme>
+static void BM_Multiply(benchmark::State &state)
+{
+	PalisadeSetup *s = setup_or_skip(Scheme, state);
+	if(s == NULL)
+		return;
+	run_or_skip(state, [&]() {
+		auto a = s->fresh();
+		auto b = s->fresh();
+		for(auto _ : state)
+			benchmark::DoNotOptimize(s->cc->EvalMultNoRelin(a, b));
+	});
+}
+
+template <PalisadeScheme Scheme>
+static void BM_Relinearize(benchmark::State &state)
+{
+	PalisadeSetup *s = setup_or_skip(Scheme, state);
+	if(s == NULL)
+		return;
+	run_or_skip(state, [&]() {
+		auto product = s->cc->EvalMultNoRelin(s->fresh(), s->fresh());
+		for(auto _ : state)
+			benchmark::DoNotOptimize(s->cc->Relinearize(product));
+	});
+}
+
+//Rescale for CKKS, modulus switch for BGVrns
+template <PalisadeScheme Scheme>
+static void BM_ModSwitch(benchmark::State &state)
+{
+	if(Scheme == BFVRNS)
+	{
+		state.SkipWithError("BFVrns has no modulus switching");
+		return;
+	}
+	PalisadeSetup *s = setup_or_skip(Scheme, state);
+	if(s == NULL)
+		return;
+	run_or_skip(state, [&]() {
+		auto product = s->cc->EvalMult(s->fresh(), s->fresh());
+		for(auto _ : state)
+			benchmark::DoNotOptimize(s->cc->ModReduce(product));
+	});
+}
+
+template <PalisadeScheme Scheme>
+static void BM_Add(benchmark::State &state)
+{
+	PalisadeSetup *s = setup_or_skip(Scheme, state);
+	if(s == NULL)
+		return;
+	run_or_skip(state, [&]() {
+		auto a = s->fresh();
+		auto b = s->fresh();
+		for(auto _ : state)
+			benchmark::DoNotOptimize(s->cc->EvalAdd(a, b));
+	});
+}
+
+template <PalisadeScheme Scheme>
+static void BM_Rotate(benchmark::State &state)
+{
+	PalisadeSetup *s = setup_or_skip(Scheme, state);
+	if(s == NULL)
+		return;
+	run_or_skip(state, [&]() {
+		auto a = s->fresh();
+		for(auto _ : state)
+			benchmark::DoNotOptimize(s->cc->EvalAtIndex(a, 1));
+	});
+}
+
+template <PalisadeScheme Scheme>
+static void BM_Decrypt(benchmark::State &state)
+{
+	PalisadeSetup *s = setup_or_skip(Scheme, state);
+	if(s == NULL)
+		return;
+	run_or_skip(state, [&]() {
+		auto a = s->fresh();
+		Plaintext plain;
+		for(auto _ : state)
+			s->cc->Decrypt(s->keys.secretKey, a, &plain);
+	});
+}
+
+template <PalisadeScheme Scheme>
+static void BM_Decode(benchmark::State &state)
+{
+	PalisadeSetup *s = setup_or_skip(Scheme, state);
+	if(s == NULL)
+		return;
+	run_or_skip(state, [&]() {
+		auto a = s->fresh();
+		Plaintext plain;
+		s->cc->Decrypt(s->keys.secretKey, a, &plain);
+
+		//CKKS decodes at the decrypted ciphertext's depth and scale
+		if(Scheme == CKKS)
+		{
+			auto params = dynamic_pointer_cast<LPCryptoParametersCKKS<DCRTPoly> >(s->cc->GetCryptoParameters());
+			for(auto _ : state)
+				plain->Decode(a->GetDepth(), a->GetScalingFactor(), params->GetRescalingTechnique());
+		}
+		else
+		{
+			for(auto _ : state)
+				plain->Decode();
+		}
+	});
+}
+
+//Ring dimensions 4096 through 32768
+#define PALISADE_BENCHMARK(fn, scheme) \
+	BENCHMARK_TEMPLATE(fn, scheme)->RangeMultiplier(2)->Range(4096, 32768)->Unit(benchmark::kMicrosecond)
+
+PALISADE_BENCHMARK(BM_Encode, BFVRNS);
+PALISADE_BENCHMARK(BM_Encrypt, BFVRNS);
+PALISADE_BENCHMARK(BM_Multiply, BFVRNS);
+PALISADE_BENCHMARK(BM_Relinearize, BFVRNS);
+PALISADE_BENCHMARK(BM_ModSwitch, BFVRNS);
+PALISADE_BENCHMARK(BM_Add, BFVRNS);
+PALISADE_BENCHMARK(BM_Rotate, BFVRNS);
+PALISADE_BENCHMARK(BM_Decrypt, BFVRNS);
+PALISADE_BENCHMARK(BM_Decode, BFVRNS);
+
+PALISADE_BENCHMARK(BM_Encode, CKKS);
+PALISADE_BENCHMARK(BM_Encrypt, CKKS);
+PALISADE_BENCHMARK(BM_Multiply, CKKS);
+PALISADE_BENCHMARK(BM_Relinearize, CKKS);
+PALISADE_BENCHMARK(BM_ModSwitch, CKKS);
+PALISADE_BENCHMARK(BM_Add, CKKS);
+PALISADE_BENCHMARK(BM_Rotate, CKKS);
+PALISADE_BENCHMARK(BM_Decrypt, CKKS);
+PALISADE_BENCHMARK(BM_Decode, CKKS);
+
+PALISADE_BENCHMARK(BM_Encode, BGVRNS);
+PALISADE_BENCHMARK(BM_Encrypt, BGVRNS);
+PALISADE_BENCHMARK(BM_Multiply, BGVRNS);
+PALISADE_BENCHMARK(BM_Relinearize, BGVRNS);
+PALISADE_BENCHMARK(BM_ModSwitch, BGVRNS);
+PALISADE_BENCHMARK(BM_Add, BGVRNS);
+PALISADE_BENCHMARK(BM_Rotate, BGVRNS);
+PALISADE_BENCHMARK(BM_Decrypt, BGVRNS);
+PALISADE_BENCHMARK(BM_Decode, BGVRNS);
+
+BENCHMARK_MAIN();
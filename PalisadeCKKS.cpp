@@ -6,7 +6,17 @@
 /* final velocity = V_i + at   m/s     */
 /***************************************/
 #include "palisade.h"
+#include "ciphertext-ser.h"
+#include "cryptocontext-ser.h"
+#include "pubkeylp-ser.h"
+#include "scheme/ckks/ckks-ser.h"
+#include "EncryptedStore.h"
+#include "Telemetry.h"
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string.h>
 #include <vector>
 #include <time.h>
 #include <stdlib.h>
@@ -37,8 +47,71 @@ void print(Plaintext v, int length)
     cout << endl;
 }
 
-int main()
+int main(int argc, char *argv[])
 {
+	//--store <path> keeps the encrypted columns and keys on disk. The first
+	//run encrypts and writes them, later runs evaluate the stored columns.
+	//--no-compact returns the result at the level evaluation ended on.
+	//--telemetry <csv> records the modulus headroom and scale after every operation.
+	//--security 128|192|256, --ring-dim D and --n N select the configuration.
+	//Without --ring-dim PALISADE picks the smallest secure ring dimension.
+	string store_path;
+	bool compact = true;
+	Telemetry telemetry;
+	int security = 128;
+	uint32_t ring_dim = 0;
+	int N = 2760;
+	bool n_given = false;
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "--store") == 0 && i + 1 < argc)
+			store_path = argv[++i];
+		else if(strcmp(argv[i], "--no-compact") == 0)
+			compact = false;
+		else if(strcmp(argv[i], "--telemetry") == 0 && i + 1 < argc)
+			telemetry.enable(argv[++i]);
+		else if(strcmp(argv[i], "--security") == 0 && i + 1 < argc)
+			security = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--ring-dim") == 0 && i + 1 < argc)
+			ring_dim = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--n") == 0 && i + 1 < argc)
+		{
+			N = atoi(argv[++i]);
+			n_given = true;
+		}
+	}
+	SecurityLevel securityLevel;
+	if(security == 128)
+		securityLevel = HEStd_128_classic;
+	else if(security == 192)
+		securityLevel = HEStd_192_classic;
+	else if(security == 256)
+		securityLevel = HEStd_256_classic;
+	else
+	{
+		cerr << "--security must be 128, 192 or 256" << endl;
+		return 2;
+	}
+	bool use_store = !store_path.empty();
+	bool store_loaded = use_store && EncryptedStore::exists(store_path);
+
+	//An existing store fixes the number of records it was written with
+	if(store_loaded)
+	{
+		uint64_t stored_n = EncryptedStore(store_path).attribute("records", N);
+		if(n_given && (uint64_t)N != stored_n)
+		{
+			cerr << "--n " << N << " conflicts with the " << stored_n << " records in store " << store_path << endl;
+			return 2;
+		}
+		N = stored_n;
+	}
+
+	//The context and keys live next to the store so stored ciphertexts stay decryptable
+	fstream key_file;
+	if(use_store)
+		key_file.open((store_path + ".keys").c_str(), ios::binary | (store_loaded ? ios::in : ios::out | ios::trunc));
+
 	/*****Setup CryptoContext*****/
 	clock_t cc_clock;
 	cc_clock = clock();
@@ -46,14 +119,44 @@ int main()
 	uint32_t multDepth = 1;
 	uint32_t scaleFactorBits = 50;
 	uint32_t batchSize = 8192; //num plaintext slots
-	SecurityLevel securityLevel = HEStd_128_classic;
+	//CKKS packs at most half the ring dimension
+	if(ring_dim != 0)
+		batchSize = min(batchSize, ring_dim / 2);
+	if(N < 0 || (uint32_t)N > batchSize)
+	{
+		cerr << "--n " << N << " does not fit in " << batchSize << " slots" << endl;
+		return 2;
+	}
 
-	CryptoContext<DCRTPoly> cc =
-			CryptoContextFactory<DCRTPoly>::genCryptoContextCKKS(
-			   multDepth,
-			   scaleFactorBits,
-			   batchSize,
-			   securityLevel);
+	CryptoContext<DCRTPoly> cc;
+	if(store_loaded)
+	{
+		CryptoContextFactory<DCRTPoly>::ReleaseAllContexts();
+		Serial::Deserialize(cc, key_file, SerType::BINARY);
+		if(ring_dim != 0 && ring_dim != cc->GetRingDimension())
+		{
+			cerr << "--ring-dim " << ring_dim << " conflicts with ring dimension " << cc->GetRingDimension() << " in store " << store_path << endl;
+			return 2;
+		}
+	}
+	else
+	{
+		//PALISADE rejects a ring dimension too small for the security level
+		try
+		{
+			cc = CryptoContextFactory<DCRTPoly>::genCryptoContextCKKS(
+				   multDepth,
+				   scaleFactorBits,
+				   batchSize,
+				   securityLevel,
+				   ring_dim);
+		}
+		catch(const std::exception &e)
+		{
+			cerr << "No valid parameters for ring dimension " << ring_dim << " at " << security << "-bit security: " << e.what() << endl;
+			return 2;
+		}
+	}
 
 	//cout << "CKKS scheme is using ring dimension " << cc->GetRingDimension() << endl << endl;
 
@@ -66,54 +169,181 @@ int main()
 	clock_t key_clock;
 	key_clock = clock();
 
-	auto keys = cc->KeyGen();
-	cc->EvalMultKeyGen(keys.secretKey);
-	cc->EvalAtIndexKeyGen(keys.secretKey, { 1, -2 });
+	LPKeyPair<DCRTPoly> keys;
+	if(store_loaded)
+	{
+		Serial::Deserialize(keys.publicKey, key_file, SerType::BINARY);
+		Serial::Deserialize(keys.secretKey, key_file, SerType::BINARY);
+		cc->DeserializeEvalMultKey(key_file, SerType::BINARY);
+		cc->DeserializeEvalAutomorphismKey(key_file, SerType::BINARY);
+	}
+	else
+	{
+		keys = cc->KeyGen();
+		cc->EvalMultKeyGen(keys.secretKey);
+		cc->EvalAtIndexKeyGen(keys.secretKey, { 1, -2 });
+
+		if(use_store)
+		{
+			Serial::Serialize(cc, key_file, SerType::BINARY);
+			Serial::Serialize(keys.publicKey, key_file, SerType::BINARY);
+			Serial::Serialize(keys.secretKey, key_file, SerType::BINARY);
+			cc->SerializeEvalMultKey(key_file, SerType::BINARY);
+			cc->SerializeEvalAutomorphismKey(key_file, SerType::BINARY);
+		}
+	}
 
 	key_clock = clock() - key_clock;
 
+	//|v_i + at| <= 50 + 25*30, so the modulus a ciphertext needs follows from
+	//its scaling factor alone and no secret key is needed to judge headroom
+	const double value_bound = 50 + 25*30;
+	auto tower_bits = [](ConstCiphertext<DCRTPoly> ct, size_t towers)
+	{
+		int bits = 0;
+		for(size_t i = 0; i < towers; i++)
+			bits += ct->GetElements()[0].GetParams()->GetParams()[i]->GetModulus().GetMSB();
+		return bits;
+	};
+
+	//Records the modulus headroom, scale and level of ct after op
+	auto probe = [&](const char *op, ConstCiphertext<DCRTPoly> ct)
+	{
+		if(!telemetry.enabled())
+			return;
+		clock_t probe_clock;
+		probe_clock = clock();
+		double scale_bits = log2(ct->GetScalingFactor());
+		size_t ct_towers = ct->GetElements()[0].GetNumOfElements();
+		telemetry.margin(op, "headroom_bits", tower_bits(ct, ct_towers) - (scale_bits + log2(value_bound) + 1));
+		telemetry.value(op, "scale_bits", scale_bits);
+		telemetry.value(op, "depth", ct->GetDepth());
+		telemetry.value(op, "towers", ct_towers);
+		telemetry.add_overhead(clock() - probe_clock);
+	};
+
 	/*****Encoding*****/
 
 	clock_t enc_clock;
 	enc_clock = clock();
 
-	int N = 2760; 
+	clock_t store_clock = 0;
+
 	vector<complex<double>> initial_velocity; 
 	vector<complex<double>> times; 
 	vector<complex<double>> acc;   
 
-	for(int i = 0; i < N; i++)
+	Plaintext plain_initial_vel;
+	Plaintext plain_times;
+	Plaintext plain_acc;
+
+	Ciphertext<DCRTPoly> enc_times;
+	Ciphertext<DCRTPoly> enc_acc;
+	Ciphertext<DCRTPoly> enc_initial_vel;
+
+	if(store_loaded)
 	{
-		complex<double> a = (rand()/(double(RAND_MAX))*25);
-		acc.push_back(a);
+		/*****Load stored columns*****/
+		store_clock = clock();
 
-		complex<double> b = (rand()/(double(RAND_MAX))*50);
-		initial_velocity.push_back(b);
+		EncryptedStore store(store_path);
+		store.load("times", 0, [&](istream &in) { Serial::Deserialize(enc_times, in, SerType::BINARY); });
+		store.load("acc", 0, [&](istream &in) { Serial::Deserialize(enc_acc, in, SerType::BINARY); });
+		store.load("initial_velocity", 0, [&](istream &in) { Serial::Deserialize(enc_initial_vel, in, SerType::BINARY); });
 
-		complex<double> c = (rand()/(double(RAND_MAX))*30);
-		times.push_back(c);
+		store_clock = clock() - store_clock;
+	}
+	else
+	{
+		for(int i = 0; i < N; i++)
+		{
+			complex<double> a = (rand()/(double(RAND_MAX))*25);
+			acc.push_back(a);
+
+			complex<double> b = (rand()/(double(RAND_MAX))*50);
+			initial_velocity.push_back(b);
+
+			complex<double> c = (rand()/(double(RAND_MAX))*30);
+			times.push_back(c);
+		}
+
+		plain_initial_vel = cc->MakeCKKSPackedPlaintext(initial_velocity);
+		plain_times = cc->MakeCKKSPackedPlaintext(times);
+		plain_acc = cc->MakeCKKSPackedPlaintext(acc);
+
+		// Encrypt the encoded vectors
+		enc_times = cc->Encrypt(keys.publicKey, plain_times);
+		enc_acc = cc->Encrypt(keys.publicKey, plain_acc);
+		enc_initial_vel = cc->Encrypt(keys.publicKey, plain_initial_vel);
+
+		if(use_store)
+		{
+			/*****Store columns*****/
+			store_clock = clock();
+
+			EncryptedStoreWriter writer(store_path);
+			writer.set_attribute("records", N);
+			Serial::Serialize(enc_times, writer.begin_chunk("times", 0), SerType::BINARY);
+			writer.end_chunk();
+			Serial::Serialize(enc_acc, writer.begin_chunk("acc", 0), SerType::BINARY);
+			writer.end_chunk();
+			Serial::Serialize(enc_initial_vel, writer.begin_chunk("initial_velocity", 0), SerType::BINARY);
+			writer.end_chunk();
+
+			store_clock = clock() - store_clock;
+		}
 	}
-	
-
-	Plaintext plain_initial_vel = cc->MakeCKKSPackedPlaintext(initial_velocity);
-	Plaintext plain_times = cc->MakeCKKSPackedPlaintext(times);
-	Plaintext plain_acc = cc->MakeCKKSPackedPlaintext(acc);
 
-	// Encrypt the encoded vectors
-	auto enc_times = cc->Encrypt(keys.publicKey, plain_times);
-	auto enc_acc = cc->Encrypt(keys.publicKey, plain_acc);
-	auto enc_initial_vel = cc->Encrypt(keys.publicKey, plain_initial_vel);
+	probe("encrypt initial_velocity", enc_initial_vel);
+	probe("encrypt times", enc_times);
+	probe("encrypt acc", enc_acc);
 
-	enc_clock = clock() - enc_clock;
+	enc_clock = clock() - enc_clock - store_clock - telemetry.take_overhead();
 
 	/*****Evaluation*****/
 	clock_t eval_clock;
 	eval_clock = clock();
 
 	auto cMult = cc->EvalMult(enc_times, enc_acc);
+	probe("multiply", cMult);
 	auto cAdd = cc->EvalAdd(cMult, enc_initial_vel);
+	probe("add", cAdd);
+
+	eval_clock = clock() - eval_clock - telemetry.take_overhead();
 
-	eval_clock = clock() - eval_clock;
+	/*****Compaction*****/
+	//Rescale the product and drop towers from the result while the remaining
+	//modulus still holds the scaled value.
+	const int headroom_margin = 8;
+
+	stringstream full_stream;
+	Serial::Serialize(cAdd, full_stream, SerType::BINARY);
+	size_t full_size = full_stream.str().size();
+
+	clock_t compact_clock;
+	compact_clock = clock();
+
+	if(compact && cAdd->GetDepth() > 1)
+	{
+		cAdd = cc->ModReduce(cAdd);
+		probe("rescale", cAdd);
+	}
+
+	int needed_bits = (int)ceil(log2(cAdd->GetScalingFactor()) + log2(value_bound)) + 1 + headroom_margin;
+	size_t towers = cAdd->GetElements()[0].GetNumOfElements();
+	while(compact && towers > 1 && tower_bits(cAdd, towers - 1) >= needed_bits)
+	{
+		cAdd = cc->LevelReduce(cAdd, nullptr, 1);
+		towers--;
+		probe("level_reduce", cAdd);
+	}
+
+	compact_clock = clock() - compact_clock - telemetry.take_overhead();
+
+	stringstream compact_stream;
+	Serial::Serialize(cAdd, compact_stream, SerType::BINARY);
+	size_t compact_size = compact_stream.str().size();
+	int headroom = tower_bits(cAdd, towers) - needed_bits + headroom_margin;
 
 	/*****Decryption and output*****/
 	clock_t dec_clock;
@@ -126,17 +356,32 @@ int main()
 
 	dec_clock = clock() - dec_clock;
 
+	//Largest deviation from the plaintext result, when the inputs are known.
+	//CKKS noise stays orders of magnitude below the tolerance; a result that
+	//decrypted wrongly does not.
+	double max_error = 0;
+	const double error_tolerance = 0.01;
+	for(size_t i = 0; i < acc.size(); i++)
+		max_error = max(max_error, abs(plain_final_vel->GetCKKSPackedValue()[i].real() - (initial_velocity[i] + acc[i] * times[i]).real()));
+
 	/*****Print*****/
 	cout << "Starting the velocity caluculator with " << N << " instances. "<< endl << endl;
 
-	cout << "Acceleration: " << endl;
-	print(plain_acc, N);
+	if(store_loaded)
+	{
+		cout << "Inputs loaded from encrypted store " << store_path << endl << endl;
+	}
+	else
+	{
+		cout << "Acceleration: " << endl;
+		print(plain_acc, N);
 
-	cout << "Initial Velocity: " << endl;
-	print(plain_initial_vel, N);
+		cout << "Initial Velocity: " << endl;
+		print(plain_initial_vel, N);
 
-	cout << "Time: " << endl;
-	print(plain_times, N);
+		cout << "Time: " << endl;
+		print(plain_times, N);
+	}
 
 	cout << " Final Velocity: " << endl;
 	print(plain_final_vel, N);
@@ -147,7 +392,31 @@ int main()
 	cout << "Encryption            : " << ((float)enc_clock)/CLOCKS_PER_SEC << endl;
 	cout << "Evaluation (v_i + at) : " << ((float)eval_clock)/CLOCKS_PER_SEC << endl;
 	cout << "Decryption            : " << ((float)dec_clock)/CLOCKS_PER_SEC << endl;
+	cout << "Compaction            : " << ((float)compact_clock)/CLOCKS_PER_SEC << endl;
+	cout << "Result Size (bytes)   : " << full_size << " -> " << compact_size << endl;
+	cout << "Result Headroom       : " << headroom << " bits" << endl;
+	if(!store_loaded)
+		cout << "Max Absolute Error    : " << max_error << endl;
+	if(use_store)
+		cout << (store_loaded ? "Store Load            : " : "Store Write           : ") << ((float)store_clock)/CLOCKS_PER_SEC << endl;
+
+	if(telemetry.enabled())
+	{
+		telemetry.timing("parameter_generation", cc_clock);
+		telemetry.timing("key_generation", key_clock);
+		telemetry.timing("encryption", enc_clock);
+		telemetry.timing("evaluation", eval_clock);
+		telemetry.timing("compaction", compact_clock);
+		telemetry.timing("decryption", dec_clock);
+		telemetry.report(cout);
+		if(!telemetry.write())
+			cerr << "Could not write telemetry file" << endl;
+	}
 
+	bool correct = store_loaded || max_error <= error_tolerance;
+	//Exit status 3 tells scripts the result failed its own check
+	if(!correct)
+		return 3;
 	return 0;
 }
 
@@ -7,40 +7,151 @@
 /****************************************/
 
 #include <iostream>
+#include <fstream>
+#include <string>
+#include <string.h>
 #include <time.h>
 #include <stdlib.h>
 #include <vector>
 #include "seal/seal.h"
 #include "examples.h"
+#include "EncryptedStore.h"
+#include "Telemetry.h"
 
 using namespace std;
 using namespace seal;
 
-int main()
+int main(int argc, char *argv[])
 {
+	//--store <path> keeps the encrypted columns and keys on disk. The first
+	//run encrypts and writes them, later runs evaluate the stored columns.
+	//--no-compact returns the result at the level evaluation ended on.
+	//--telemetry <csv> records the scale, level and headroom after every operation.
+	//--security 128|192|256, --ring-dim D and --n N select the configuration.
+	string store_path;
+	bool compact = true;
+	Telemetry telemetry;
+	int security = 128;
+	size_t poly_modulus_degree = 8192;
+	int N = 2760;
+	bool n_given = false;
+	bool ring_dim_given = false;
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "--store") == 0 && i + 1 < argc)
+			store_path = argv[++i];
+		else if(strcmp(argv[i], "--no-compact") == 0)
+			compact = false;
+		else if(strcmp(argv[i], "--telemetry") == 0 && i + 1 < argc)
+			telemetry.enable(argv[++i]);
+		else if(strcmp(argv[i], "--security") == 0 && i + 1 < argc)
+			security = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--ring-dim") == 0 && i + 1 < argc)
+		{
+			poly_modulus_degree = atoi(argv[++i]);
+			ring_dim_given = true;
+		}
+		else if(strcmp(argv[i], "--n") == 0 && i + 1 < argc)
+		{
+			N = atoi(argv[++i]);
+			n_given = true;
+		}
+	}
+	sec_level_type sec_level;
+	if(security == 128)
+		sec_level = sec_level_type::tc128;
+	else if(security == 192)
+		sec_level = sec_level_type::tc192;
+	else if(security == 256)
+		sec_level = sec_level_type::tc256;
+	else
+	{
+		cerr << "--security must be 128, 192 or 256" << endl;
+		return 2;
+	}
+	bool use_store = !store_path.empty();
+	bool store_loaded = use_store && EncryptedStore::exists(store_path);
+
+	//An existing store fixes the number of records it was written with
+	if(store_loaded)
+	{
+		uint64_t stored_n = EncryptedStore(store_path).attribute("records", N);
+		if(n_given && (uint64_t)N != stored_n)
+		{
+			cerr << "--n " << N << " conflicts with the " << stored_n << " records in store " << store_path << endl;
+			return 2;
+		}
+		N = stored_n;
+	}
+
+	//Parameters and keys live next to the store so stored ciphertexts stay decryptable
+	fstream key_file;
+	if(use_store)
+		key_file.open((store_path + ".keys").c_str(), ios::binary | (store_loaded ? ios::in : ios::out | ios::trunc));
+
 	/*****Set Parameters and Context*****/
 	clock_t cc_clock;
 	cc_clock = clock();
 
 	EncryptionParameters parms(scheme_type::CKKS);
 
-	 size_t poly_modulus_degree = 8192;
-    parms.set_poly_modulus_degree(poly_modulus_degree);
-    parms.set_coeff_modulus(CoeffModulus::Create(
-        poly_modulus_degree, { 60, 40, 40, 60 }));
+	if(store_loaded)
+	{
+		parms.load(key_file);
+		if(ring_dim_given && poly_modulus_degree != parms.poly_modulus_degree())
+		{
+			cerr << "--ring-dim " << poly_modulus_degree << " conflicts with ring dimension " << parms.poly_modulus_degree() << " in store " << store_path << endl;
+			return 2;
+		}
+	}
+	else
+	{
+		parms.set_poly_modulus_degree(poly_modulus_degree);
+		parms.set_coeff_modulus(CoeffModulus::Create(
+			poly_modulus_degree, { 60, 40, 40, 60 }));
+	}
 
 	double scale = pow(2.0, 40);
 
-    auto context = SEALContext::Create(parms);
+    auto context = SEALContext::Create(parms, true, sec_level);
+	//The 200-bit modulus needs a ring dimension of 8192 at 128 bits, 16384 above
+	if(!context->parameters_set())
+	{
+		cerr << "No valid parameters for ring dimension " << parms.poly_modulus_degree() << " at " << security << "-bit security" << endl;
+		return 2;
+	}
 
 	/*****Key Generation*****/
 	clock_t key_clock;
 	key_clock = clock();
 
-    KeyGenerator keygen(context);
-    auto public_key = keygen.public_key();
-    auto secret_key = keygen.secret_key();
-    auto relin_keys = keygen.relin_keys();
+	PublicKey public_key;
+	SecretKey secret_key;
+	RelinKeys relin_keys;
+
+	if(store_loaded)
+	{
+		public_key.load(context, key_file);
+		secret_key.load(context, key_file);
+		relin_keys.load(context, key_file);
+	}
+	else
+	{
+		KeyGenerator keygen(context);
+		public_key = keygen.public_key();
+		secret_key = keygen.secret_key();
+		relin_keys = keygen.relin_keys();
+
+		if(use_store)
+		{
+			parms.save(key_file);
+			public_key.save(key_file);
+			secret_key.save(key_file);
+			relin_keys.save(key_file);
+		}
+	}
+	key_clock = clock() - key_clock;
+
     Encryptor encryptor(context, public_key);
     Evaluator evaluator(context);
     Decryptor decryptor(context, secret_key);
@@ -48,42 +159,99 @@ int main()
     CKKSEncoder encoder(context);
     size_t slot_count = encoder.slot_count();
     cout << "Number of slots: " << slot_count << endl;
+	if(N < 0 || (size_t)N > slot_count)
+	{
+		cerr << "--n " << N << " does not fit in " << slot_count << " slots" << endl;
+		return 2;
+	}
 	cc_clock = clock() - cc_clock - key_clock;
 
+	//Headroom is what is left of the modulus at ct's level once the scaled
+	//value is accounted for; |v_i + at| <= 50 + 25*30 bounds every value here
+	const double value_bound = 50 + 25*30;
+	auto probe = [&](const char *op, const Ciphertext &ct)
+	{
+		if(!telemetry.enabled())
+			return;
+		clock_t probe_clock;
+		probe_clock = clock();
+		auto data = context->get_context_data(ct.parms_id());
+		double scale_bits = log2(ct.scale());
+		telemetry.margin(op, "headroom_bits", data->total_coeff_modulus_bit_count() - ceil(scale_bits + log2(value_bound)) - 1);
+		telemetry.value(op, "scale_bits", scale_bits);
+		telemetry.value(op, "chain_index", data->chain_index());
+		telemetry.add_overhead(clock() - probe_clock);
+	};
+
 	/*****Encode and Encrypt*****/
 	clock_t enc_clock;
 	enc_clock = clock();
+	clock_t store_clock = 0;
 
-    int N = 2760; 
 	vector<double> initial_velocity; 
 	vector<double> times; 
 	vector<double> acc;   
 
-	for(int i = 0; i < N; i++)
+    Ciphertext enc_initial_vel, enc_times, enc_acc;
+
+	if(store_loaded)
 	{
-		double a = (rand()/(double(RAND_MAX))*25);
-		acc.push_back(a);
+		/*****Load stored columns*****/
+		store_clock = clock();
 
-		double b = (rand()/(double(RAND_MAX))*50);
-		initial_velocity.push_back(b);
+		EncryptedStore store(store_path);
+		store.load("initial_velocity", 0, [&](istream &in) { enc_initial_vel.load(context, in); });
+		store.load("times", 0, [&](istream &in) { enc_times.load(context, in); });
+		store.load("acc", 0, [&](istream &in) { enc_acc.load(context, in); });
 
-		double c = (rand()/(double(RAND_MAX))*30);
-		times.push_back(c);
+		store_clock = clock() - store_clock;
+	}
+	else
+	{
+		for(int i = 0; i < N; i++)
+		{
+			double a = (rand()/(double(RAND_MAX))*25);
+			acc.push_back(a);
+
+			double b = (rand()/(double(RAND_MAX))*50);
+			initial_velocity.push_back(b);
+
+			double c = (rand()/(double(RAND_MAX))*30);
+			times.push_back(c);
+		}
+
+		Plaintext plain_initial_vel, plain_times, plain_acc;
+		encoder.encode(initial_velocity, scale, plain_initial_vel);
+		encoder.encode(times, scale, plain_times);
+		encoder.encode(acc, scale, plain_acc);
+
+		encryptor.encrypt(plain_initial_vel, enc_initial_vel);
+		encryptor.encrypt(plain_times, enc_times);
+		encryptor.encrypt(plain_acc, enc_acc);
+
+		if(use_store)
+		{
+			/*****Store columns*****/
+			store_clock = clock();
+
+			EncryptedStoreWriter writer(store_path);
+			writer.set_attribute("records", N);
+			enc_initial_vel.save(writer.begin_chunk("initial_velocity", 0));
+			writer.end_chunk();
+			enc_times.save(writer.begin_chunk("times", 0));
+			writer.end_chunk();
+			enc_acc.save(writer.begin_chunk("acc", 0));
+			writer.end_chunk();
+
+			store_clock = clock() - store_clock;
+		}
 	}
 
+	probe("encrypt initial_velocity", enc_initial_vel);
+	probe("encrypt times", enc_times);
+	probe("encrypt acc", enc_acc);
 
-
-    Plaintext plain_initial_vel, plain_times, plain_acc;
-    encoder.encode(initial_velocity, scale, plain_initial_vel);
-    encoder.encode(times, scale, plain_times);
-    encoder.encode(acc, scale, plain_acc);
-
-    Ciphertext enc_initial_vel, enc_times, enc_acc;
-    encryptor.encrypt(plain_initial_vel, enc_initial_vel);
-	encryptor.encrypt(plain_times, enc_times);
-	encryptor.encrypt(plain_acc, enc_acc);
-
-	enc_clock = clock() - enc_clock;
+	enc_clock = clock() - enc_clock - store_clock - telemetry.take_overhead();
 
     /*****Evaluate*****/
 	clock_t eval_clock;
@@ -92,8 +260,11 @@ int main()
     Ciphertext enc_final_vel;
 
     evaluator.multiply(enc_acc, enc_times, enc_final_vel);
+	probe("multiply", enc_final_vel);
 	evaluator.relinearize_inplace(enc_final_vel, relin_keys);
+	probe("relinearize", enc_final_vel);
 	evaluator.rescale_to_next_inplace(enc_final_vel);
+	probe("rescale", enc_final_vel);
 	
 	enc_final_vel.scale() = pow(2.0,40);
 	enc_initial_vel.scale() = pow(2.0,40);
@@ -101,8 +272,33 @@ int main()
 	parms_id_type last_parms_id = enc_final_vel.parms_id();
 	evaluator.mod_switch_to_inplace(enc_initial_vel, last_parms_id);
 	evaluator.add_inplace(enc_final_vel, enc_initial_vel);
+	probe("add", enc_final_vel);
 
-	eval_clock = clock() - eval_clock;
+	eval_clock = clock() - eval_clock - telemetry.take_overhead();
+
+	/*****Compact*****/
+	//Drop primes from the result while the remaining modulus still holds the
+	//scaled value. The value bound above makes this work without the secret key.
+	const int headroom_margin = 8;
+	int needed_bits = (int)ceil(log2(enc_final_vel.scale()) + log2(value_bound)) + 1 + headroom_margin;
+	size_t full_size = enc_final_vel.save_size(compr_mode_type::none);
+
+	clock_t compact_clock;
+	compact_clock = clock();
+
+	while(compact)
+	{
+		auto next_data = context->get_context_data(enc_final_vel.parms_id())->next_context_data();
+		if(!next_data || next_data->total_coeff_modulus_bit_count() < needed_bits)
+			break;
+		evaluator.mod_switch_to_next_inplace(enc_final_vel);
+		probe("mod_switch", enc_final_vel);
+	}
+
+	compact_clock = clock() - compact_clock - telemetry.take_overhead();
+
+	size_t compact_size = enc_final_vel.save_size(compr_mode_type::none);
+	int headroom = context->get_context_data(enc_final_vel.parms_id())->total_coeff_modulus_bit_count() - needed_bits + headroom_margin;
 
 	/*****Decrypt*****/
 	clock_t dec_clock;
@@ -117,16 +313,31 @@ int main()
 	vector<double> final_vel;
 	encoder.decode(plain_final_vel, final_vel);
 
+	//Largest deviation from the plaintext result, when the inputs are known.
+	//CKKS noise stays orders of magnitude below the tolerance; a result that
+	//decrypted wrongly does not.
+	double max_error = 0;
+	const double error_tolerance = 0.01;
+	for(size_t i = 0; i < acc.size(); i++)
+		max_error = max(max_error, fabs(final_vel[i] - (initial_velocity[i] + acc[i] * times[i])));
+
 	/*****Print*****/
 	cout << "Starting the velocity caluculator with " << N << " instances. "<< endl << endl;
-	cout << "Acceleration: " << endl;
-	print_vector(acc, 10, 4);
+	if(store_loaded)
+	{
+		cout << "Inputs loaded from encrypted store " << store_path << endl << endl;
+	}
+	else
+	{
+		cout << "Acceleration: " << endl;
+		print_vector(acc, 10, 4);
 
-	cout << "Initial Velocity: " << endl;
-	print_vector(initial_velocity, 10, 4);
+		cout << "Initial Velocity: " << endl;
+		print_vector(initial_velocity, 10, 4);
 
-	cout << "Time: " << endl;
-	print_vector(times, 10, 4);
+		cout << "Time: " << endl;
+		print_vector(times, 10, 4);
+	}
 
 	cout << " Final Velocity: " << endl;
 	print_vector(final_vel, 10, 4);
@@ -137,5 +348,30 @@ int main()
 	cout << "Encryption            : " << ((float)enc_clock)/CLOCKS_PER_SEC << endl;
 	cout << "Evaluation (v_i + at) : " << ((float)eval_clock)/CLOCKS_PER_SEC << endl;
 	cout << "Decryption            : " << ((float)dec_clock)/CLOCKS_PER_SEC << endl;
+	cout << "Compaction            : " << ((float)compact_clock)/CLOCKS_PER_SEC << endl;
+	cout << "Result Size (bytes)   : " << full_size << " -> " << compact_size << endl;
+	cout << "Result Headroom       : " << headroom << " bits" << endl;
+	if(!store_loaded)
+		cout << "Max Absolute Error    : " << max_error << endl;
+	if(use_store)
+		cout << (store_loaded ? "Store Load            : " : "Store Write           : ") << ((float)store_clock)/CLOCKS_PER_SEC << endl;
+
+	if(telemetry.enabled())
+	{
+		telemetry.timing("parameter_generation", cc_clock);
+		telemetry.timing("key_generation", key_clock);
+		telemetry.timing("encryption", enc_clock);
+		telemetry.timing("evaluation", eval_clock);
+		telemetry.timing("compaction", compact_clock);
+		telemetry.timing("decryption", dec_clock);
+		telemetry.report(cout);
+		if(!telemetry.write())
+			cerr << "Could not write telemetry file" << endl;
+	}
 
+	bool correct = store_loaded || max_error <= error_tolerance;
+	//Exit status 3 tells scripts the result failed its own check
+	if(!correct)
+		return 3;
+	return 0;
 }
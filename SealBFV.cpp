@@ -7,44 +7,211 @@
 /****************************************/
 
 #include <iostream>
+#include <fstream>
+#include <string>
+#include <string.h>
 #include <time.h>
 #include <stdlib.h>
 #include <vector>
+#include <math.h>
 #include "seal/seal.h"
 #include "examples.h"
+#include "EncryptedStore.h"
+#include "IncrementalCache.h"
+#include "FixedPoint.h"
+#include "Telemetry.h"
+#include "AllocationCounter.h"
 
 using namespace std;
 using namespace seal;
 
-int main()
+int main(int argc, char *argv[])
 {
+	//--store <path> keeps the encrypted columns and keys on disk. The first
+	//run encrypts and writes them, later runs evaluate the stored columns.
+	//--no-compact returns the result at the level evaluation ended on, and
+	//--compact-level L switches it to chain index L instead of the estimated level.
+	//--updates R then runs R incremental update rounds in which acceleration
+	//and time each change with probability --churn percent.
+	//--fixed-point F runs on real-valued inputs encoded with F fractional bits.
+	//--telemetry <csv> records the noise budget after every operation.
+	//--security 128|192|256, --ring-dim D and --n N select the configuration.
+	//--stream R re-evaluates the inputs R times and counts heap allocations.
+	string store_path;
+	Telemetry telemetry;
+	bool compact = true;
+	int compact_level = -1;
+	int updates = 0;
+	int churn = 5;
+	int frac_bits = 0;
+	int security = 128;
+	size_t poly_modulus_degree = 8192;
+	int N = 2760; //or 100 or 1000
+	bool n_given = false;
+	bool ring_dim_given = false;
+	int stream_runs = 0;
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "--store") == 0 && i + 1 < argc)
+			store_path = argv[++i];
+		else if(strcmp(argv[i], "--no-compact") == 0)
+			compact = false;
+		else if(strcmp(argv[i], "--compact-level") == 0 && i + 1 < argc)
+			compact_level = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--updates") == 0 && i + 1 < argc)
+			updates = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--churn") == 0 && i + 1 < argc)
+			churn = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--fixed-point") == 0 && i + 1 < argc)
+			frac_bits = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--telemetry") == 0 && i + 1 < argc)
+			telemetry.enable(argv[++i]);
+		else if(strcmp(argv[i], "--security") == 0 && i + 1 < argc)
+			security = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--ring-dim") == 0 && i + 1 < argc)
+		{
+			poly_modulus_degree = atoi(argv[++i]);
+			ring_dim_given = true;
+		}
+		else if(strcmp(argv[i], "--n") == 0 && i + 1 < argc)
+		{
+			N = atoi(argv[++i]);
+			n_given = true;
+		}
+		else if(strcmp(argv[i], "--stream") == 0 && i + 1 < argc)
+			stream_runs = atoi(argv[++i]);
+	}
+	sec_level_type sec_level;
+	if(security == 128)
+		sec_level = sec_level_type::tc128;
+	else if(security == 192)
+		sec_level = sec_level_type::tc192;
+	else if(security == 256)
+		sec_level = sec_level_type::tc256;
+	else
+	{
+		cerr << "--security must be 128, 192 or 256" << endl;
+		return 2;
+	}
+	bool use_store = !store_path.empty();
+	bool store_loaded = use_store && EncryptedStore::exists(store_path);
+
+	//An existing store fixes the number of records it was written with
+	if(store_loaded)
+	{
+		uint64_t stored_n = EncryptedStore(store_path).attribute("records", N);
+		if(n_given && (uint64_t)N != stored_n)
+		{
+			cerr << "--n " << N << " conflicts with the " << stored_n << " records in store " << store_path << endl;
+			return 2;
+		}
+		N = stored_n;
+	}
+
+	//Fixed point: a and t are encoded at 2^F, so a*t and v_i live at 2^2F and
+	//the plaintext modulus must hold |v_i + at| <= 50 + 25*30 at that scale
+	bool fixed_point = frac_bits > 0;
+	FixedPointCodec codec(frac_bits);
+	int result_scale = FixedPointCodec::product_scale(codec.input_scale(), codec.input_scale());
+	int plain_modulus_bits = fixed_point ? FixedPointCodec::plain_modulus_bits(50 + 25*30, result_scale) : 20;
+	//Batching needs a prime = 1 mod 2n, and there is none at narrower widths
+	int batching_bits = (int)log2((double)(2 * poly_modulus_degree)) + 2;
+	if(plain_modulus_bits < batching_bits)
+		plain_modulus_bits = batching_bits;
+	if(fixed_point && (use_store || updates > 0))
+	{
+		cerr << "--fixed-point cannot be combined with --store or --updates" << endl;
+		return 2;
+	}
+	if(plain_modulus_bits > 60)
+	{
+		cerr << "--fixed-point " << frac_bits << " needs a " << plain_modulus_bits << "-bit plaintext modulus; SEAL allows at most 60" << endl;
+		return 2;
+	}
+
+	//Parameters and keys live next to the store so stored ciphertexts stay decryptable
+	fstream key_file;
+	if(use_store)
+		key_file.open((store_path + ".keys").c_str(), ios::binary | (store_loaded ? ios::in : ios::out | ios::trunc));
+
 	/*****Choose Parameters*****/
 	clock_t cc_clock;
 	cc_clock = clock();
 
 	EncryptionParameters parms(scheme_type::BFV);
-	size_t poly_modulus_degree = 8192;
-	parms.set_poly_modulus_degree(poly_modulus_degree);
-	parms.set_coeff_modulus(CoeffModulus::BFVDefault(poly_modulus_degree));
+	if(store_loaded)
+	{
+		parms.load(key_file);
+		if(ring_dim_given && poly_modulus_degree != parms.poly_modulus_degree())
+		{
+			cerr << "--ring-dim " << poly_modulus_degree << " conflicts with ring dimension " << parms.poly_modulus_degree() << " in store " << store_path << endl;
+			return 2;
+		}
+		poly_modulus_degree = parms.poly_modulus_degree();
+	}
+	else
+	{
+		parms.set_poly_modulus_degree(poly_modulus_degree);
+		parms.set_coeff_modulus(CoeffModulus::BFVDefault(poly_modulus_degree, sec_level));
 
-	//Enable batching
-	parms.set_plain_modulus(PlainModulus::Batching(poly_modulus_degree, 20));
+		//Enable batching
+		try
+		{
+			parms.set_plain_modulus(PlainModulus::Batching(poly_modulus_degree, plain_modulus_bits));
+		}
+		catch(const exception &e)
+		{
+			cerr << "No " << plain_modulus_bits << "-bit batching plaintext modulus for ring dimension " << poly_modulus_degree << ": " << e.what() << endl;
+			return 2;
+		}
+	}
 
-	auto context = SEALContext::Create(parms);
+	auto context = SEALContext::Create(parms, true, sec_level);
 	//print_parameters(context);
+	if(!context->parameters_set())
+	{
+		cerr << "No valid parameters for ring dimension " << poly_modulus_degree << " at " << security << "-bit security" << endl;
+		return 2;
+	}
 	
 	//Verify that batching is enabled
-	//auto qualifiers = context->first_context_data()->qualifiers();
-	//cout << "Batching enabled: " << boolalpha << qualifiers.using_batching << endl;
+	if(telemetry.enabled())
+	{
+		auto qualifiers = context->first_context_data()->qualifiers();
+		cout << "Batching enabled: " << boolalpha << qualifiers.using_batching << endl;
+		telemetry.value("context", "coeff_modulus_bits", context->first_context_data()->total_coeff_modulus_bit_count());
+		telemetry.value("context", "plain_modulus_bits", parms.plain_modulus().bit_count());
+	}
 
 	/*****Generate keys and functions*****/
 	clock_t key_clock;
 	key_clock = clock();
 
-	KeyGenerator keygen(context);
-	PublicKey public_key = keygen.public_key();
-	SecretKey secret_key = keygen.secret_key();
-	RelinKeys relin_keys = keygen.relin_keys();
+	PublicKey public_key;
+	SecretKey secret_key;
+	RelinKeys relin_keys;
+
+	if(store_loaded)
+	{
+		public_key.load(context, key_file);
+		secret_key.load(context, key_file);
+		relin_keys.load(context, key_file);
+	}
+	else
+	{
+		KeyGenerator keygen(context);
+		public_key = keygen.public_key();
+		secret_key = keygen.secret_key();
+		relin_keys = keygen.relin_keys();
+
+		if(use_store)
+		{
+			parms.save(key_file);
+			public_key.save(key_file);
+			secret_key.save(key_file);
+			relin_keys.save(key_file);
+		}
+	}
 
 	key_clock = clock() - key_clock;
 
@@ -56,54 +223,125 @@ int main()
 	BatchEncoder batch_encoder(context);
 	size_t slot_count = batch_encoder.slot_count();
 	size_t row_size = slot_count / 2;
+	if(N < 0 || (size_t)N > slot_count)
+	{
+		cerr << "--n " << N << " does not fit in " << slot_count << " slots" << endl;
+		return 2;
+	}
+
+	//Records the remaining noise budget and level of ct after op
+	auto probe = [&](const char *op, const Ciphertext &ct)
+	{
+		if(!telemetry.enabled())
+			return;
+		clock_t probe_clock;
+		probe_clock = clock();
+		telemetry.margin(op, "noise_budget_bits", decryptor.invariant_noise_budget(ct));
+		telemetry.value(op, "chain_index", context->get_context_data(ct.parms_id())->chain_index());
+		telemetry.add_overhead(clock() - probe_clock);
+	};
 	
 	
 	cc_clock = clock() - cc_clock - key_clock;
 	
 	clock_t enc_clock;
 	enc_clock = clock();
+	clock_t store_clock = 0;
 	//Generate the matrices of values 
-	int N = 2760; //or 100 or 1000
 	vector<uint64_t> initial_velocity(slot_count, 0ULL);    
 	vector<uint64_t> times(slot_count, 0ULL);               
 	vector<uint64_t> acc(slot_count, 0ULL);                 
+	vector<double> initial_velocity_real(slot_count, 0.0);
+	vector<double> times_real(slot_count, 0.0);
+	vector<double> acc_real(slot_count, 0.0);
 
-	for(int r = 0; r < 2; r++)
+	Ciphertext enc_initial_vel;
+	Ciphertext enc_times;
+	Ciphertext enc_acc;
+
+	if(store_loaded)
+	{
+		/*****Load stored columns*****/
+		store_clock = clock();
+
+		EncryptedStore store(store_path);
+		store.load("initial_velocity", 0, [&](istream &in) { enc_initial_vel.load(context, in); });
+		store.load("times", 0, [&](istream &in) { enc_times.load(context, in); });
+		store.load("acc", 0, [&](istream &in) { enc_acc.load(context, in); });
+
+		store_clock = clock() - store_clock;
+	}
+	else
 	{
-		for(int c = 0; c < N/2; c++) 
+		for(int r = 0; r < 2; r++)
 		{
-			unsigned long long int a = rand() % 25;
-			acc[r*row_size + c] = a;
+			for(int c = 0; c < N/2; c++) 
+			{
+				if(fixed_point)
+				{
+					acc_real[r*row_size + c] = rand()/(double(RAND_MAX))*25;
+					initial_velocity_real[r*row_size + c] = rand()/(double(RAND_MAX))*50;
+					times_real[r*row_size + c] = rand()/(double(RAND_MAX))*30;
+					continue;
+				}
 
-			unsigned long long int b = rand() % 50;
-			initial_velocity[r*row_size + c] = b;
+				unsigned long long int a = rand() % 25;
+				acc[r*row_size + c] = a;
 
-			unsigned long long int d = rand() % 30;
-			times[r*row_size + c] = d;
+				unsigned long long int b = rand() % 50;
+				initial_velocity[r*row_size + c] = b;
+
+				unsigned long long int d = rand() % 30;
+				times[r*row_size + c] = d;
+			}
 		}
-	}
-	
-	
-	
-	/*****Encode*****/
-	Plaintext plain_initial_vel;
-	Plaintext plain_times;
-	Plaintext plain_acc;
 
-	batch_encoder.encode(initial_velocity, plain_initial_vel);
-	batch_encoder.encode(times, plain_times);
-	batch_encoder.encode(acc, plain_acc);
+		/*****Encode*****/
+		Plaintext plain_initial_vel;
+		Plaintext plain_times;
+		Plaintext plain_acc;
 
-	/*****Encrypt*****/
-	Ciphertext enc_initial_vel;
-	Ciphertext enc_times;
-	Ciphertext enc_acc;
+		if(fixed_point)
+		{
+			batch_encoder.encode(codec.encode(initial_velocity_real, result_scale), plain_initial_vel);
+			batch_encoder.encode(codec.encode(times_real, codec.input_scale()), plain_times);
+			batch_encoder.encode(codec.encode(acc_real, codec.input_scale()), plain_acc);
+		}
+		else
+		{
+			batch_encoder.encode(initial_velocity, plain_initial_vel);
+			batch_encoder.encode(times, plain_times);
+			batch_encoder.encode(acc, plain_acc);
+		}
 
-	encryptor.encrypt(plain_initial_vel, enc_initial_vel);
-	encryptor.encrypt(plain_times, enc_times);
-	encryptor.encrypt(plain_acc, enc_acc);
+		/*****Encrypt*****/
+		encryptor.encrypt(plain_initial_vel, enc_initial_vel);
+		encryptor.encrypt(plain_times, enc_times);
+		encryptor.encrypt(plain_acc, enc_acc);
 
-	enc_clock = clock() - enc_clock;
+		if(use_store)
+		{
+			/*****Store columns*****/
+			store_clock = clock();
+
+			EncryptedStoreWriter writer(store_path);
+			writer.set_attribute("records", N);
+			enc_initial_vel.save(writer.begin_chunk("initial_velocity", 0));
+			writer.end_chunk();
+			enc_times.save(writer.begin_chunk("times", 0));
+			writer.end_chunk();
+			enc_acc.save(writer.begin_chunk("acc", 0));
+			writer.end_chunk();
+
+			store_clock = clock() - store_clock;
+		}
+	}
+
+	probe("encrypt initial_velocity", enc_initial_vel);
+	probe("encrypt times", enc_times);
+	probe("encrypt acc", enc_acc);
+
+	enc_clock = clock() - enc_clock - store_clock - telemetry.take_overhead();
 
 	/*****Evaluate*****/
 	clock_t eval_clock;
@@ -112,9 +350,49 @@ int main()
 	Ciphertext enc_final_vel;
 
 	evaluator.multiply(enc_acc, enc_times, enc_final_vel);
+	probe("multiply", enc_final_vel);
 	evaluator.add_inplace(enc_final_vel, enc_initial_vel);
+	probe("add", enc_final_vel);
+
+	eval_clock = clock() - eval_clock - telemetry.take_overhead();
+
+	/*****Compact*****/
+	//Switch the result down the modulus chain while the estimated noise budget
+	//stays above a safety margin. The estimate only uses the parameters and the
+	//circuit, so the server needs no secret key. Invariant noise is relative to
+	//q, so a switch keeps it until the rounding noise of the smaller modulus
+	//(about n/q') takes over. A fresh encryption carries less than n of noise,
+	//the product multiplies it by at most 2tn and the add costs one bit.
+	const int noise_margin = 8;
+	size_t full_size = enc_final_vel.save_size(compr_mode_type::none);
 
-	eval_clock = clock() - eval_clock;
+	int t_bits = parms.plain_modulus().bit_count();
+	int n_bits = (int)log2(poly_modulus_degree);
+	int eval_budget = context->first_context_data()->total_coeff_modulus_bit_count() - t_bits - 1 - n_bits - (t_bits + n_bits + 1) - 1;
+	auto estimated_budget = [&](shared_ptr<const SEALContext::ContextData> data)
+	{
+		return min(eval_budget, data->total_coeff_modulus_bit_count() - t_bits - 1 - n_bits);
+	};
+
+	clock_t compact_clock;
+	compact_clock = clock();
+
+	while(compact)
+	{
+		auto data = context->get_context_data(enc_final_vel.parms_id());
+		auto next_data = data->next_context_data();
+		if(!next_data)
+			break;
+		if(compact_level >= 0 ? (int)data->chain_index() <= compact_level : estimated_budget(next_data) < noise_margin)
+			break;
+		evaluator.mod_switch_to_next_inplace(enc_final_vel);
+		probe("mod_switch", enc_final_vel);
+	}
+
+	compact_clock = clock() - compact_clock - telemetry.take_overhead();
+
+	size_t compact_size = enc_final_vel.save_size(compr_mode_type::none);
+	int noise_budget = decryptor.invariant_noise_budget(enc_final_vel);
 
 	/*****Decrypt*****/
 	clock_t dec_clock;
@@ -128,21 +406,200 @@ int main()
 
 	/*****Decode*****/
 	vector<uint64_t> final_vel;
-	batch_encoder.decode(plain_final_vel, final_vel);
+	vector<double> final_vel_real;
+	double max_error = 0;
+	if(fixed_point)
+	{
+		vector<int64_t> final_vel_fixed;
+		batch_encoder.decode(plain_final_vel, final_vel_fixed);
+		final_vel_real = codec.decode(final_vel_fixed, result_scale);
+
+		//Largest deviation from the exact real-valued result
+		for(size_t i = 0; i < slot_count; i++)
+			max_error = max(max_error, fabs(final_vel_real[i] - (initial_velocity_real[i] + acc_real[i] * times_real[i])));
+	}
+	else
+	{
+		batch_encoder.decode(plain_final_vel, final_vel);
+	}
+
+	//Decryption-correctness check of the compacted result, when the inputs are known
+	size_t mismatches = 0;
+	if(!fixed_point && !store_loaded)
+	{
+		uint64_t plain_modulus = parms.plain_modulus().value();
+		for(size_t i = 0; i < slot_count; i++)
+			if(final_vel[i] != (initial_velocity[i] + acc[i] * times[i]) % plain_modulus)
+				mismatches++;
+	}
+
+	/*****Streaming*****/
+	//Allocating and in-place paths; see "Allocation-free streaming" in README.md
+	clock_t stream_alloc_clock = 0;
+	clock_t stream_inplace_clock = 0;
+	uint64_t stream_alloc_count = 0;
+	uint64_t stream_inplace_count = 0;
+	size_t stream_alloc_pool_bytes = 0;
+	size_t stream_inplace_pool_bytes = 0;
+	bool stream_match = true;
+
+	if(stream_runs > 0)
+	{
+		//Each path draws its temporaries from its own pool
+		MemoryPoolHandle alloc_pool = MemoryPoolHandle::New();
+		MemoryPoolHandle inplace_pool = MemoryPoolHandle::New();
+		parms_id_type result_parms_id = enc_final_vel.parms_id();
+
+		auto evaluate_allocating = [&]()
+		{
+			Ciphertext batch_vel(alloc_pool);
+			evaluator.multiply(enc_acc, enc_times, batch_vel, alloc_pool);
+			evaluator.add_inplace(batch_vel, enc_initial_vel);
+			evaluator.mod_switch_to_inplace(batch_vel, result_parms_id, alloc_pool);
+		};
+
+		Ciphertext stream_vel(context, context->first_parms_id(), 3, inplace_pool);
+		auto evaluate_inplace = [&]()
+		{
+			stream_vel = enc_acc;
+			evaluator.multiply_inplace(stream_vel, enc_times, inplace_pool);
+			evaluator.add_inplace(stream_vel, enc_initial_vel);
+			evaluator.mod_switch_to_inplace(stream_vel, result_parms_id, inplace_pool);
+		};
+
+		//The first batch of each path sizes its buffers and pool and is not counted
+		evaluate_allocating();
+		uint64_t allocations = AllocationCounter::count();
+		size_t pool_bytes = alloc_pool.alloc_byte_count();
+		stream_alloc_clock = clock();
+		for(int run = 0; run < stream_runs; run++)
+			evaluate_allocating();
+		stream_alloc_clock = clock() - stream_alloc_clock;
+		stream_alloc_count = AllocationCounter::count() - allocations;
+		stream_alloc_pool_bytes = alloc_pool.alloc_byte_count() - pool_bytes;
+
+		evaluate_inplace();
+		allocations = AllocationCounter::count();
+		pool_bytes = inplace_pool.alloc_byte_count();
+		stream_inplace_clock = clock();
+		for(int run = 0; run < stream_runs; run++)
+			evaluate_inplace();
+		stream_inplace_clock = clock() - stream_inplace_clock;
+		stream_inplace_count = AllocationCounter::count() - allocations;
+		stream_inplace_pool_bytes = inplace_pool.alloc_byte_count() - pool_bytes;
+
+		Plaintext plain_stream_vel;
+		decryptor.decrypt(stream_vel, plain_stream_vel);
+		stream_match = plain_stream_vel == plain_final_vel;
+	}
+
+	/*****Incremental updates*****/
+	//Update rounds work on copies of the inputs; see "Incremental updates" in README.md
+	IncrementalCache<Ciphertext> cache([](const Ciphertext &ct) { return (size_t)ct.save_size(compr_mode_type::none); });
+	uint64_t acc_version = 0;
+	uint64_t times_version = 0;
+	bool acc_known = !store_loaded;
+	bool times_known = !store_loaded;
+	clock_t update_clock = 0;
+	size_t update_mismatches = 0;
+	Ciphertext enc_update_vel;
+	vector<uint64_t> update_initial_velocity(initial_velocity);
+	vector<uint64_t> update_times(times);
+	vector<uint64_t> update_acc(acc);
+	Ciphertext enc_update_initial_vel(enc_initial_vel);
+	Ciphertext enc_update_times(enc_times);
+	Ciphertext enc_update_acc(enc_acc);
+
+	auto refresh = [&](vector<uint64_t> &column, int range, Ciphertext &encrypted)
+	{
+		for(int r = 0; r < 2; r++)
+			for(int c = 0; c < N/2; c++)
+				column[r*row_size + c] = rand() % range;
+
+		Plaintext plain;
+		batch_encoder.encode(column, plain);
+		encryptor.encrypt(plain, encrypted);
+	};
+
+	for(int round = 0; round < updates; round++)
+	{
+		refresh(update_initial_velocity, 50, enc_update_initial_vel);
+		if(rand() % 100 < churn)
+		{
+			refresh(update_acc, 25, enc_update_acc);
+			acc_version++;
+			acc_known = true;
+		}
+		if(rand() % 100 < churn)
+		{
+			refresh(update_times, 30, enc_update_times);
+			times_version++;
+			times_known = true;
+		}
+
+		clock_t round_clock;
+		round_clock = clock();
+
+		const Ciphertext &enc_acc_times = cache.get("acc*times", { acc_version, times_version }, [&]()
+		{
+			Ciphertext product;
+			evaluator.multiply(enc_update_acc, enc_update_times, product);
+			evaluator.relinearize_inplace(product, relin_keys);
+			return product;
+		});
+		evaluator.add(enc_acc_times, enc_update_initial_vel, enc_update_vel);
+
+		update_clock += clock() - round_clock;
+	}
+
+	//Check the last round against the plaintext inputs, when they are known
+	if(updates > 0 && acc_known && times_known)
+	{
+		Plaintext plain_update_vel;
+		vector<uint64_t> update_vel;
+		decryptor.decrypt(enc_update_vel, plain_update_vel);
+		batch_encoder.decode(plain_update_vel, update_vel);
+
+		for(size_t i = 0; i < slot_count; i++)
+			if(update_vel[i] != update_initial_velocity[i] + update_acc[i] * update_times[i])
+				update_mismatches++;
+	}
 	
 	/*****Print*****/
 	cout << "Starting the velocity caluculator with " << N << " instances. "<< endl << endl;
-	cout << "Acceleration: " << endl;
-	print_matrix(acc, row_size);
+	if(store_loaded)
+	{
+		cout << "Inputs loaded from encrypted store " << store_path << endl << endl;
+	}
+	else if(fixed_point)
+	{
+		cout << "Fixed point with " << frac_bits << " fractional bits, " << plain_modulus_bits << "-bit plaintext modulus" << endl << endl;
+		cout << "Acceleration: " << endl;
+		print_vector(acc_real, 10, 4);
 
-	cout << "Initial Velocity: " << endl;
-	print_matrix(initial_velocity, row_size);
+		cout << "Initial Velocity: " << endl;
+		print_vector(initial_velocity_real, 10, 4);
 
-	cout << "Time: " << endl;
-	print_matrix(times, row_size);
+		cout << "Time: " << endl;
+		print_vector(times_real, 10, 4);
+	}
+	else
+	{
+		cout << "Acceleration: " << endl;
+		print_matrix(acc, row_size);
+
+		cout << "Initial Velocity: " << endl;
+		print_matrix(initial_velocity, row_size);
+
+		cout << "Time: " << endl;
+		print_matrix(times, row_size);
+	}
 
 	cout << " Final Velocity: " << endl;
-	print_matrix(final_vel, row_size);
+	if(fixed_point)
+		print_vector(final_vel_real, 10, 4);
+	else
+		print_matrix(final_vel, row_size);
 
 	cout << "Times:" <<endl;
 	cout << "Parameter Generation  : " << ((float)cc_clock)/CLOCKS_PER_SEC << endl;
@@ -150,6 +607,51 @@ int main()
 	cout << "Encryption            : " << ((float)enc_clock)/CLOCKS_PER_SEC << endl;
 	cout << "Evaluation (v_i + at) : " << ((float)eval_clock)/CLOCKS_PER_SEC << endl;
 	cout << "Decryption            : " << ((float)dec_clock)/CLOCKS_PER_SEC << endl;
+	cout << "Compaction            : " << ((float)compact_clock)/CLOCKS_PER_SEC << endl;
+	cout << "Result Size (bytes)   : " << full_size << " -> " << compact_size << endl;
+	cout << "Result Noise Budget   : " << noise_budget << " bits" << endl;
+	if(fixed_point)
+		cout << "Max Absolute Error    : " << max_error << endl;
+	else if(!store_loaded)
+		cout << "Result Mismatches     : " << mismatches << endl;
+	if(use_store)
+		cout << (store_loaded ? "Store Load            : " : "Store Write           : ") << ((float)store_clock)/CLOCKS_PER_SEC << endl;
+	if(stream_runs > 0)
+	{
+		double records = (double)stream_runs * N;
+		cout << "Stream Allocating     : " << ((float)stream_alloc_clock)/CLOCKS_PER_SEC/stream_runs << " per batch, " << stream_alloc_count / records << " allocations per record, "
+			<< stream_alloc_pool_bytes << " new pool bytes" << endl;
+		cout << "Stream In-Place       : " << ((float)stream_inplace_clock)/CLOCKS_PER_SEC/stream_runs << " per batch, " << stream_inplace_count / records << " allocations per record, "
+			<< stream_inplace_pool_bytes << " new pool bytes" << endl;
+		cout << "Stream Result Matches : " << boolalpha << stream_match << endl;
+	}
+	if(updates > 0)
+	{
+		cout << "Update Evaluation     : " << ((float)update_clock)/CLOCKS_PER_SEC/updates << " per round over " << updates << " rounds" << endl;
+		cout << "Cache Hit Rate        : " << cache.hit_rate() * 100 << "% (" << cache.hits() << " hits, " << cache.misses() << " misses)" << endl;
+		cout << "Cache Memory (bytes)  : " << cache.bytes() << endl;
+		if(acc_known && times_known)
+			cout << "Update Mismatches     : " << update_mismatches << endl;
+	}
+
+	if(telemetry.enabled())
+	{
+		telemetry.timing("parameter_generation", cc_clock);
+		telemetry.timing("key_generation", key_clock);
+		telemetry.timing("encryption", enc_clock);
+		telemetry.timing("evaluation", eval_clock);
+		telemetry.timing("compaction", compact_clock);
+		telemetry.timing("decryption", dec_clock);
+		telemetry.report(cout);
+		if(!telemetry.write())
+			cerr << "Could not write telemetry file" << endl;
+	}
 
+	bool correct = noise_budget > 0 && mismatches == 0 && stream_match && update_mismatches == 0;
+	if(fixed_point && max_error > codec.rounding_error(25, 30))
+		correct = false;
+	//Exit status 3 tells scripts the result failed its own check
+	if(!correct)
+		return 3;
 	return 0;
 }
@@ -0,0 +1,537 @@
+/****************************************/
+/* SEAL BFV sharded velocity calculator */
+/* A coordinator builds the keys once   */
+/* and publishes the evaluation keys in */
+/* POSIX shared memory; worker          */
+/* processes pull chunks from a shared  */
+/* queue and write the results back     */
+/* final velocity = V_i + at   m/s      */
+/****************************************/
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <atomic>
+#include <sstream>
+#include <memory>
+#include <string>
+#include <string.h>
+#include <time.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "seal/seal.h"
+#include "EncryptedStore.h"
+
+using namespace std;
+using namespace seal;
+
+static const char *KEYS_SHM = "/velocity_keys";
+static const char *QUEUE_SHM = "/velocity_queue";
+static const int MAX_WORKERS = 64;
+
+struct WorkerStats
+{
+	uint32_t chunks;
+	long rss_kb;
+	long peak_rss_kb;
+	long pss_kb;
+	double loop_start;
+	double loop_end;
+};
+
+//Start of the queue segment. The input slots (initial velocity, time and
+//acceleration for each chunk) follow it, then one result slot per chunk.
+struct QueueHeader
+{
+	atomic<uint32_t> next_chunk;
+	uint32_t chunk_count;
+	uint64_t slot_bytes;
+	uint64_t keys_bytes;
+	WorkerStats stats[MAX_WORKERS];
+};
+
+enum Column { INITIAL_VELOCITY, TIMES, ACC };
+
+static char *input_slot(QueueHeader *queue, uint32_t chunk, Column column)
+{
+	return reinterpret_cast<char *>(queue + 1) + (chunk * 3 + column) * queue->slot_bytes;
+}
+
+static char *result_slot(QueueHeader *queue, uint32_t chunk)
+{
+	return reinterpret_cast<char *>(queue + 1) + (queue->chunk_count * 3 + chunk) * queue->slot_bytes;
+}
+
+//Write-only stream buffer over one slot of the queue segment
+class SlotBuf : public streambuf
+{
+public:
+	SlotBuf(char *data, size_t size)
+	{
+		setp(data, data + size);
+	}
+};
+
+//Reads a "<field>: <n> kB" line from a /proc/self file
+static long proc_kb(const char *path, const char *field)
+{
+	FILE *status = fopen(path, "r");
+	if(status == NULL)
+		return -1;
+
+	char line[256];
+	long kb = -1;
+	size_t field_len = strlen(field);
+	while(fgets(line, sizeof(line), status) != NULL)
+	{
+		if(strncmp(line, field, field_len) == 0 && line[field_len] == ':')
+		{
+			kb = atol(line + field_len + 1);
+			break;
+		}
+	}
+	fclose(status);
+	return kb;
+}
+
+static void *map_shm(const char *name, int flags, int prot, size_t *size)
+{
+	int fd = shm_open(name, flags, 0600);
+	if(fd < 0)
+	{
+		perror(name);
+		exit(1);
+	}
+
+	if(flags & O_CREAT)
+	{
+		if(ftruncate(fd, *size) != 0)
+		{
+			perror(name);
+			exit(1);
+		}
+	}
+	else
+	{
+		struct stat st;
+		fstat(fd, &st);
+		*size = st.st_size;
+	}
+
+	void *map = mmap(NULL, *size, prot, MAP_SHARED, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED)
+	{
+		perror(name);
+		exit(1);
+	}
+	return map;
+}
+
+static double wall_seconds()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static QueueHeader *attach_queue(size_t *queue_size)
+{
+	return static_cast<QueueHeader *>(map_shm(QUEUE_SHM, O_RDWR, PROT_READ | PROT_WRITE, queue_size));
+}
+
+//Builds the evaluation-only context and relinearization keys from the
+//published key segment. Nothing here can encrypt or decrypt.
+static shared_ptr<SEALContext> load_evaluation_keys(QueueHeader *queue, RelinKeys &relin_keys)
+{
+	size_t keys_size = 0;
+	const char *keys = static_cast<const char *>(map_shm(KEYS_SHM, O_RDONLY, PROT_READ, &keys_size));
+
+	MappedChunkBuf key_buf(keys, queue->keys_bytes);
+	istream key_stream(&key_buf);
+
+	EncryptionParameters parms(scheme_type::BFV);
+	parms.load(key_stream);
+	auto context = SEALContext::Create(parms);
+	relin_keys.load(context, key_stream);
+
+	munmap(const_cast<char *>(keys), keys_size);
+	return context;
+}
+
+/*****Worker*****/
+//Pulls chunks until the queue is empty, then records its memory use. The
+//loop is timed on its own so process start and key loading stay out of it.
+static void evaluate_chunks(int id, QueueHeader *queue, shared_ptr<SEALContext> context, const RelinKeys &relin_keys)
+{
+	Evaluator evaluator(context);
+
+	Ciphertext enc_initial_vel;
+	Ciphertext enc_times;
+	Ciphertext enc_acc;
+	Ciphertext enc_final_vel;
+
+	queue->stats[id].loop_start = wall_seconds();
+
+	uint32_t chunks = 0;
+	uint32_t chunk;
+	while((chunk = queue->next_chunk.fetch_add(1)) < queue->chunk_count)
+	{
+		MappedChunkBuf vel_buf(input_slot(queue, chunk, INITIAL_VELOCITY), queue->slot_bytes);
+		MappedChunkBuf times_buf(input_slot(queue, chunk, TIMES), queue->slot_bytes);
+		MappedChunkBuf acc_buf(input_slot(queue, chunk, ACC), queue->slot_bytes);
+		istream vel_in(&vel_buf);
+		istream times_in(&times_buf);
+		istream acc_in(&acc_buf);
+		enc_initial_vel.load(context, vel_in);
+		enc_times.load(context, times_in);
+		enc_acc.load(context, acc_in);
+
+		evaluator.multiply(enc_acc, enc_times, enc_final_vel);
+		evaluator.relinearize_inplace(enc_final_vel, relin_keys);
+		evaluator.add_inplace(enc_final_vel, enc_initial_vel);
+
+		SlotBuf result_buf(result_slot(queue, chunk), queue->slot_bytes);
+		ostream result_out(&result_buf);
+		enc_final_vel.save(result_out, compr_mode_type::none);
+
+		chunks++;
+	}
+
+	queue->stats[id].loop_end = wall_seconds();
+	queue->stats[id].chunks = chunks;
+	queue->stats[id].rss_kb = proc_kb("/proc/self/status", "VmRSS");
+	queue->stats[id].peak_rss_kb = proc_kb("/proc/self/status", "VmHWM");
+	//Pages shared with other workers count fractionally
+	queue->stats[id].pss_kb = proc_kb("/proc/self/smaps_rollup", "Pss");
+}
+
+//exec mode: a fresh image that deserializes its own context and keys
+static int run_worker(int id)
+{
+	size_t queue_size = 0;
+	QueueHeader *queue = attach_queue(&queue_size);
+
+	RelinKeys relin_keys;
+	auto context = load_evaluation_keys(queue, relin_keys);
+	evaluate_chunks(id, queue, context, relin_keys);
+
+	munmap(queue, queue_size);
+	return 0;
+}
+
+//Waits for every child and reports whether all of them exited cleanly
+static bool wait_all(const vector<pid_t> &pids)
+{
+	bool ok = true;
+	for(size_t i = 0; i < pids.size(); i++)
+	{
+		int status = 0;
+		if(pids[i] < 0 || waitpid(pids[i], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			ok = false;
+	}
+	return ok;
+}
+
+//fork mode: an exec'd server, which never holds the public or secret key,
+//builds the context and relinearization keys once and forks the workers
+//without exec. Their pages stay shared copy-on-write across the pool.
+static int run_server(int workers)
+{
+	size_t queue_size = 0;
+	QueueHeader *queue = attach_queue(&queue_size);
+
+	RelinKeys relin_keys;
+	auto context = load_evaluation_keys(queue, relin_keys);
+
+	vector<pid_t> pids;
+	for(int id = 0; id < workers; id++)
+	{
+		pid_t pid = fork();
+		if(pid == 0)
+		{
+			try
+			{
+				evaluate_chunks(id, queue, context, relin_keys);
+			}
+			catch(const exception &e)
+			{
+				cerr << "worker " << id << ": " << e.what() << endl;
+				_exit(1);
+			}
+			_exit(0);
+		}
+		pids.push_back(pid);
+	}
+	bool ok = wait_all(pids);
+
+	munmap(queue, queue_size);
+	return ok ? 0 : 1;
+}
+
+//Starts a fresh image of this program in the given role
+static pid_t spawn(const char *self, const char *role, int arg)
+{
+	pid_t pid = fork();
+	if(pid == 0)
+	{
+		string arg_string = to_string(arg);
+		execl("/proc/self/exe", self, role, arg_string.c_str(), (char *)NULL);
+		perror("execl");
+		_exit(1);
+	}
+	return pid;
+}
+
+static void unlink_segments()
+{
+	shm_unlink(QUEUE_SHM);
+	shm_unlink(KEYS_SHM);
+}
+
+/*****Coordinator*****/
+int main(int argc, char *argv[])
+{
+	//--workers W runs the evaluation with 1, 2, 4, ... up to W workers,
+	//--chunks C sets how many full ciphertexts of records go through the queue.
+	//--worker and --server are the roles the coordinator starts itself in.
+	int max_workers = 4;
+	int chunks = 16;
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "--worker") == 0 && i + 1 < argc)
+			return run_worker(atoi(argv[i + 1]));
+		else if(strcmp(argv[i], "--server") == 0 && i + 1 < argc)
+			return run_server(atoi(argv[i + 1]));
+		else if(strcmp(argv[i], "--workers") == 0 && i + 1 < argc)
+			max_workers = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--chunks") == 0 && i + 1 < argc)
+			chunks = atoi(argv[++i]);
+	}
+	if(max_workers < 1 || max_workers > MAX_WORKERS)
+	{
+		cerr << "--workers must be between 1 and " << MAX_WORKERS << endl;
+		return 2;
+	}
+	if(chunks < 1)
+	{
+		cerr << "--chunks must be at least 1" << endl;
+		return 2;
+	}
+	uint32_t chunk_count = chunks;
+
+	/*****Choose Parameters*****/
+	clock_t cc_clock;
+	cc_clock = clock();
+
+	EncryptionParameters parms(scheme_type::BFV);
+	size_t poly_modulus_degree = 8192;
+	parms.set_poly_modulus_degree(poly_modulus_degree);
+	parms.set_coeff_modulus(CoeffModulus::BFVDefault(poly_modulus_degree));
+
+	//Enable batching
+	parms.set_plain_modulus(PlainModulus::Batching(poly_modulus_degree, 20));
+
+	auto context = SEALContext::Create(parms);
+
+	cc_clock = clock() - cc_clock;
+
+	/*****Generate keys and publish*****/
+	clock_t key_clock;
+	key_clock = clock();
+
+	KeyGenerator keygen(context);
+	PublicKey public_key = keygen.public_key();
+	SecretKey secret_key = keygen.secret_key();
+	RelinKeys relin_keys = keygen.relin_keys();
+
+	stringstream key_stream;
+	parms.save(key_stream, compr_mode_type::none);
+	relin_keys.save(key_stream, compr_mode_type::none);
+	string key_bytes = key_stream.str();
+
+	//From here on every return or exit() removes both segments
+	atexit(unlink_segments);
+
+	size_t keys_size = key_bytes.size();
+	shm_unlink(KEYS_SHM);
+	char *keys = static_cast<char *>(map_shm(KEYS_SHM, O_CREAT | O_RDWR, PROT_READ | PROT_WRITE, &keys_size));
+	memcpy(keys, key_bytes.data(), key_bytes.size());
+	munmap(keys, keys_size);
+
+	key_clock = clock() - key_clock;
+
+	Encryptor encryptor(context, public_key);
+	Decryptor decryptor(context, secret_key);
+	BatchEncoder batch_encoder(context);
+	size_t slot_count = batch_encoder.slot_count();
+
+	/*****Encrypt and enqueue*****/
+	clock_t enc_clock;
+	enc_clock = clock();
+
+	vector<vector<uint64_t> > initial_velocity(chunk_count, vector<uint64_t>(slot_count));
+	vector<vector<uint64_t> > times(chunk_count, vector<uint64_t>(slot_count));
+	vector<vector<uint64_t> > acc(chunk_count, vector<uint64_t>(slot_count));
+	vector<Ciphertext> enc_columns(chunk_count * 3);
+
+	for(uint32_t chunk = 0; chunk < chunk_count; chunk++)
+	{
+		for(size_t i = 0; i < slot_count; i++)
+		{
+			acc[chunk][i] = rand() % 25;
+			initial_velocity[chunk][i] = rand() % 50;
+			times[chunk][i] = rand() % 30;
+		}
+
+		Plaintext plain;
+		batch_encoder.encode(initial_velocity[chunk], plain);
+		encryptor.encrypt(plain, enc_columns[chunk * 3 + INITIAL_VELOCITY]);
+		batch_encoder.encode(times[chunk], plain);
+		encryptor.encrypt(plain, enc_columns[chunk * 3 + TIMES]);
+		batch_encoder.encode(acc[chunk], plain);
+		encryptor.encrypt(plain, enc_columns[chunk * 3 + ACC]);
+	}
+
+	//Relinearized results have the same size and level as fresh ciphertexts,
+	//so every slot holds one uncompressed ciphertext
+	uint64_t slot_bytes = enc_columns[0].save_size(compr_mode_type::none);
+	size_t queue_size = sizeof(QueueHeader) + chunk_count * 4 * slot_bytes;
+	shm_unlink(QUEUE_SHM);
+	QueueHeader *queue = static_cast<QueueHeader *>(map_shm(QUEUE_SHM, O_CREAT | O_RDWR, PROT_READ | PROT_WRITE, &queue_size));
+	queue->chunk_count = chunk_count;
+	queue->slot_bytes = slot_bytes;
+	queue->keys_bytes = key_bytes.size();
+
+	for(uint32_t chunk = 0; chunk < chunk_count; chunk++)
+	{
+		for(int column = INITIAL_VELOCITY; column <= ACC; column++)
+		{
+			SlotBuf buf(input_slot(queue, chunk, static_cast<Column>(column)), slot_bytes);
+			ostream out(&buf);
+			enc_columns[chunk * 3 + column].save(out, compr_mode_type::none);
+		}
+	}
+	enc_columns.clear();
+
+	enc_clock = clock() - enc_clock;
+
+	/*****Evaluate with a growing worker pool*****/
+	//exec: every worker is a fresh image with private copies of the context and
+	//relinearization keys. fork: one server loads them and forks the workers.
+	cout << "Starting the sharded velocity caluculator with " << chunk_count * slot_count << " instances in "
+		<< chunk_count << " chunks. " << endl << endl;
+	cout << "Published keys        : " << key_bytes.size() / 1024 << " kB" << endl;
+	cout << "Coordinator RSS       : " << proc_kb("/proc/self/status", "VmRSS") << " kB" << endl << endl;
+	cout << "Mode  Workers  Wall incl. startup (s)  Loop (s)  Records/s  Mismatches  Chunks/worker  Mean RSS (kB)  Mean PSS (kB)  Max Peak RSS (kB)" << endl;
+
+	vector<int> pool_sizes;
+	for(int workers = 1; workers < max_workers; workers *= 2)
+		pool_sizes.push_back(workers);
+	pool_sizes.push_back(max_workers);
+
+	const char *modes[] = { "exec", "fork" };
+	bool correct = true;
+	for(int mode = 0; mode < 2; mode++)
+	{
+		for(size_t round = 0; round < pool_sizes.size(); round++)
+		{
+			int workers = pool_sizes[round];
+			queue->next_chunk = 0;
+			memset(queue->stats, 0, sizeof(queue->stats));
+			memset(result_slot(queue, 0), 0, chunk_count * slot_bytes);
+
+			double start = wall_seconds();
+
+			vector<pid_t> pids;
+			if(mode == 0)
+			{
+				for(int id = 0; id < workers; id++)
+					pids.push_back(spawn(argv[0], "--worker", id));
+			}
+			else
+			{
+				pids.push_back(spawn(argv[0], "--server", workers));
+			}
+			bool ok = wait_all(pids);
+
+			double wall = wall_seconds() - start;
+
+			cout << setw(4) << modes[mode] << "  " << setw(7) << workers << "  ";
+			if(!ok)
+			{
+				cout << "a worker failed, round skipped" << endl;
+				correct = false;
+				continue;
+			}
+
+			/*****Decrypt and check*****/
+			size_t mismatches = 0;
+			uint64_t plain_modulus = parms.plain_modulus().value();
+			try
+			{
+				for(uint32_t chunk = 0; chunk < chunk_count; chunk++)
+				{
+					Ciphertext enc_final_vel;
+					Plaintext plain_final_vel;
+					vector<uint64_t> final_vel;
+
+					MappedChunkBuf buf(result_slot(queue, chunk), slot_bytes);
+					istream in(&buf);
+					enc_final_vel.load(context, in);
+					decryptor.decrypt(enc_final_vel, plain_final_vel);
+					batch_encoder.decode(plain_final_vel, final_vel);
+
+					for(size_t i = 0; i < slot_count; i++)
+						if(final_vel[i] != (initial_velocity[chunk][i] + acc[chunk][i] * times[chunk][i]) % plain_modulus)
+							mismatches++;
+				}
+			}
+			catch(const exception &e)
+			{
+				cout << "unreadable result (" << e.what() << "), round skipped" << endl;
+				correct = false;
+				continue;
+			}
+
+			long rss_total = 0, pss_total = 0, peak_max = 0;
+			uint32_t chunk_max = 0;
+			double loop_start = queue->stats[0].loop_start, loop_end = queue->stats[0].loop_end;
+			for(int id = 0; id < workers; id++)
+			{
+				rss_total += queue->stats[id].rss_kb;
+				pss_total += queue->stats[id].pss_kb;
+				peak_max = max(peak_max, queue->stats[id].peak_rss_kb);
+				chunk_max = max(chunk_max, queue->stats[id].chunks);
+				loop_start = min(loop_start, queue->stats[id].loop_start);
+				loop_end = max(loop_end, queue->stats[id].loop_end);
+			}
+			double loop = loop_end - loop_start;
+			if(mismatches > 0)
+				correct = false;
+
+			cout << setw(22) << wall << "  " << setw(8) << loop << "  " << setw(9) << (long)(chunk_count * slot_count / loop)
+				<< "  " << setw(10) << mismatches << "  " << setw(13) << chunk_max
+				<< "  " << setw(13) << rss_total / workers << "  " << setw(13) << pss_total / workers
+				<< "  " << setw(17) << peak_max << endl;
+		}
+	}
+
+	munmap(queue, queue_size);
+
+	cout << endl << "Times:" <<endl;
+	cout << "Parameter Generation  : " << ((float)cc_clock)/CLOCKS_PER_SEC << endl;
+	cout << "Key Generation        : " << ((float)key_clock)/CLOCKS_PER_SEC << endl;
+	cout << "Encryption            : " << ((float)enc_clock)/CLOCKS_PER_SEC << endl;
+
+	//Exit status 3 tells scripts a round failed or decrypted wrongly
+	if(!correct)
+		return 3;
+	return 0;
+}
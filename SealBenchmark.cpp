@@ -0,0 +1,390 @@
+/****************************************/
+/* SEAL BFV/CKKS primitive benchmarks   */
+/* Per-operation costs for the building */
+/* blocks of the velocity calculators   */
+/* Built on Google Benchmark            */
+/****************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <stdlib.h>
+#include <utility>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "seal/seal.h"
+#include "FixedPoint.h"
+
+using namespace std;
+using namespace seal;
+
+//Context, keys and encoders for one (scheme, ring dimension) pair. Built once
+//and shared by every benchmark so key generation never shows up in the timings.
+struct SealSetup
+{
+	scheme_type scheme;
+	shared_ptr<SEALContext> context;
+	PublicKey public_key;
+	SecretKey secret_key;
+	RelinKeys relin_keys;
+	GaloisKeys galois_keys;
+	unique_ptr<Encryptor> encryptor;
+	unique_ptr<Evaluator> evaluator;
+	unique_ptr<Decryptor> decryptor;
+	unique_ptr<BatchEncoder> batch_encoder;
+	unique_ptr<CKKSEncoder> ckks_encoder;
+	double scale;
+	vector<uint64_t> int_values;
+	vector<double> real_values;
+
+	void encode(Plaintext &plain)
+	{
+		if(scheme == scheme_type::BFV)
+			batch_encoder->encode(int_values, plain);
+		else
+			ckks_encoder->encode(real_values, scale, plain);
+	}
+
+	void decode(const Plaintext &plain)
+	{
+		if(scheme == scheme_type::BFV)
+			batch_encoder->decode(plain, int_values);
+		else
+			ckks_encoder->decode(plain, real_values);
+	}
+
+	Ciphertext fresh()
+	{
+		Plaintext plain;
+		Ciphertext encrypted;
+		encode(plain);
+		encryptor->encrypt(plain, encrypted);
+		return encrypted;
+	}
+};
+
+//Coefficient moduli for CKKS: one special prime, a few 2^scale-sized primes
+//for rescaling, and the total kept under the 128-bit security bound for n
+static vector<int> ckks_bit_sizes(size_t n, double &scale)
+{
+	switch(n)
+	{
+	case 4096:
+		scale = pow(2.0, 24);
+		return { 30, 24, 24, 30 };
+	case 8192:
+		scale = pow(2.0, 40);
+		return { 60, 40, 40, 60 };
+	case 16384:
+		scale = pow(2.0, 40);
+		return { 60, 40, 40, 40, 40, 40, 60 };
+	default:
+		scale = pow(2.0, 40);
+		return { 60, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 60 };
+	}
+}
+
+static SealSetup &seal_setup(scheme_type scheme, size_t n)
+{
+	static map<pair<int, size_t>, unique_ptr<SealSetup> > setups;
+	unique_ptr<SealSetup> &s = setups[make_pair(static_cast<int>(scheme), n)];
+	if(s)
+		return *s;
+
+	s.reset(new SealSetup());
+	s->scheme = scheme;
+
+	EncryptionParameters parms(scheme);
+	parms.set_poly_modulus_degree(n);
+	if(scheme == scheme_type::BFV)
+	{
+		parms.set_coeff_modulus(CoeffModulus::BFVDefault(n));
+		parms.set_plain_modulus(PlainModulus::Batching(n, 20));
+	}
+	else
+	{
+		parms.set_coeff_modulus(CoeffModulus::Create(n, ckks_bit_sizes(n, s->scale)));
+	}
+	s->context = SEALContext::Create(parms);
+
+	KeyGenerator keygen(s->context);
+	s->public_key = keygen.public_key();
+	s->secret_key = keygen.secret_key();
+	s->relin_keys = keygen.relin_keys();
+	s->galois_keys = keygen.galois_keys(vector<int>{ 1 });
+
+	s->encryptor.reset(new Encryptor(s->context, s->public_key));
+	s->evaluator.reset(new Evaluator(s->context));
+	s->decryptor.reset(new Decryptor(s->context, s->secret_key));
+
+	if(scheme == scheme_type::BFV)
+	{
+		s->batch_encoder.reset(new BatchEncoder(s->context));
+		for(size_t i = 0; i < s->batch_encoder->slot_count(); i++)
+			s->int_values.push_back(rand() % 30);
+	}
+	else
+	{
+		s->ckks_encoder.reset(new CKKSEncoder(s->context));
+		for(size_t i = 0; i < s->ckks_encoder->slot_count(); i++)
+			s->real_values.push_back(rand()/(double(RAND_MAX))*30);
+	}
+
+	return *s;
+}
+
+template <scheme_type Scheme>
+static void BM_Encode(benchmark::State &state)
+{
+	SealSetup &s = seal_setup(Scheme, state.range(0));
+	Plaintext plain;
+	for(auto _ : state)
+		s.encode(plain);
+}
+
+template <scheme_type Scheme>
+static void BM_Encrypt(benchmark::State &state)
+{
+	SealSetup &s = seal_setup(Scheme, state.range(0));
+	Plaintext plain;
+	Ciphertext encrypted;
+	s.encode(plain);
+	for(auto _ : state)
+		s.encryptor->encrypt(plain, encrypted);
+}
+
+template <scheme_type Scheme>
+static void BM_Multiply(benchmark::State &state)
+{
+	SealSetup &s = seal_setup(Scheme, state.range(0));
+	Ciphertext a = s.fresh(), b = s.fresh(), product;
+	for(auto _ : state)
+		s.evaluator->multiply(a, b, product);
+}
+
+template <scheme_type Scheme>
+static void BM_Relinearize(benchmark::State &state)
+{
+	SealSetup &s = seal_setup(Scheme, state.range(0));
+	Ciphertext a = s.fresh(), b = s.fresh(), product, relinearized;
+	s.evaluator->multiply(a, b, product);
+	for(auto _ : state)
+		s.evaluator->relinearize(product, s.relin_keys, relinearized);
+}
+
+//Rescale for CKKS, modulus switch for BFV
+template <scheme_type Scheme>
+static void BM_ModSwitch(benchmark::State &state)
+{
+	SealSetup &s = seal_setup(Scheme, state.range(0));
+	Ciphertext a = s.fresh(), b = s.fresh(), product, switched;
+	s.evaluator->multiply(a, b, product);
+	s.evaluator->relinearize_inplace(product, s.relin_keys);
+	for(auto _ : state)
+	{
+		if(Scheme == scheme_type::CKKS)
+			s.evaluator->rescale_to_next(product, switched);
+		else
+			s.evaluator->mod_switch_to_next(product, switched);
+	}
+}
+
+template <scheme_type Scheme>
+static void BM_Add(benchmark::State &state)
+{
+	SealSetup &s = seal_setup(Scheme, state.range(0));
+	Ciphertext a = s.fresh(), b = s.fresh(), sum;
+	for(auto _ : state)
+		s.evaluator->add(a, b, sum);
+}
+
+template <scheme_type Scheme>
+static void BM_Rotate(benchmark::State &state)
+{
+	SealSetup &s = seal_setup(Scheme, state.range(0));
+	Ciphertext a = s.fresh(), rotated;
+	for(auto _ : state)
+	{
+		if(Scheme == scheme_type::CKKS)
+			s.evaluator->rotate_vector(a, 1, s.galois_keys, rotated);
+		else
+			s.evaluator->rotate_rows(a, 1, s.galois_keys, rotated);
+	}
+}
+
+template <scheme_type Scheme>
+static void BM_Decrypt(benchmark::State &state)
+{
+	SealSetup &s = seal_setup(Scheme, state.range(0));
+	Ciphertext a = s.fresh();
+	Plaintext plain;
+	for(auto _ : state)
+		s.decryptor->decrypt(a, plain);
+}
+
+template <scheme_type Scheme>
+static void BM_Decode(benchmark::State &state)
+{
+	SealSetup &s = seal_setup(Scheme, state.range(0));
+	Ciphertext a = s.fresh();
+	Plaintext plain;
+	s.decryptor->decrypt(a, plain);
+	for(auto _ : state)
+		s.decode(plain);
+}
+
+//Real-valued inputs in the ranges the calculators use
+struct VelocityInputs
+{
+	vector<double> initial_velocity;
+	vector<double> times;
+	vector<double> acc;
+
+	explicit VelocityInputs(size_t slots)
+	{
+		for(size_t i = 0; i < slots; i++)
+		{
+			acc.push_back(rand()/(double(RAND_MAX))*25);
+			initial_velocity.push_back(rand()/(double(RAND_MAX))*50);
+			times.push_back(rand()/(double(RAND_MAX))*30);
+		}
+	}
+
+	double max_error(const vector<double> &final_vel) const
+	{
+		double error = 0;
+		for(size_t i = 0; i < acc.size(); i++)
+			error = max(error, fabs(final_vel[i] - (initial_velocity[i] + acc[i] * times[i])));
+		return error;
+	}
+};
+
+//Full v_i + at pipeline (encode, encrypt, evaluate, decrypt, decode) on
+//real-valued inputs with F fractional bits, F being the benchmark argument.
+//BFV encodes a and t at 2^F. CKKS gets 2^(F + 20) as its scale since encoding
+//and relinearization noise eat roughly 20 bits of it; max_abs_error shows
+//whether the two actually land at the same precision.
+static void BM_VelocityFixedPointBFV(benchmark::State &state)
+{
+	size_t n = 8192;
+	FixedPointCodec codec(state.range(0));
+	int result_scale = FixedPointCodec::product_scale(codec.input_scale(), codec.input_scale());
+	int plain_modulus_bits = FixedPointCodec::plain_modulus_bits(50 + 25*30, result_scale);
+
+	EncryptionParameters parms(scheme_type::BFV);
+	parms.set_poly_modulus_degree(n);
+	parms.set_coeff_modulus(CoeffModulus::BFVDefault(n));
+	parms.set_plain_modulus(PlainModulus::Batching(n, plain_modulus_bits));
+	auto context = SEALContext::Create(parms);
+
+	KeyGenerator keygen(context);
+	RelinKeys relin_keys = keygen.relin_keys();
+	Encryptor encryptor(context, keygen.public_key());
+	Evaluator evaluator(context);
+	Decryptor decryptor(context, keygen.secret_key());
+	BatchEncoder encoder(context);
+
+	VelocityInputs inputs(encoder.slot_count());
+	Plaintext plain_initial_vel, plain_times, plain_acc, plain_final_vel;
+	Ciphertext enc_initial_vel, enc_times, enc_acc, enc_final_vel;
+	vector<int64_t> final_vel;
+
+	for(auto _ : state)
+	{
+		encoder.encode(codec.encode(inputs.initial_velocity, result_scale), plain_initial_vel);
+		encoder.encode(codec.encode(inputs.times, codec.input_scale()), plain_times);
+		encoder.encode(codec.encode(inputs.acc, codec.input_scale()), plain_acc);
+		encryptor.encrypt(plain_initial_vel, enc_initial_vel);
+		encryptor.encrypt(plain_times, enc_times);
+		encryptor.encrypt(plain_acc, enc_acc);
+
+		evaluator.multiply(enc_acc, enc_times, enc_final_vel);
+		evaluator.relinearize_inplace(enc_final_vel, relin_keys);
+		evaluator.add_inplace(enc_final_vel, enc_initial_vel);
+
+		decryptor.decrypt(enc_final_vel, plain_final_vel);
+		encoder.decode(plain_final_vel, final_vel);
+	}
+
+	state.SetItemsProcessed(state.iterations() * encoder.slot_count());
+	state.counters["max_abs_error"] = inputs.max_error(codec.decode(final_vel, result_scale));
+	state.counters["plain_modulus_bits"] = plain_modulus_bits;
+}
+
+static void BM_VelocityCKKS(benchmark::State &state)
+{
+	size_t n = 8192;
+	int scale_bits = state.range(0) + 20;
+	double scale = pow(2.0, scale_bits);
+
+	EncryptionParameters parms(scheme_type::CKKS);
+	parms.set_poly_modulus_degree(n);
+	parms.set_coeff_modulus(CoeffModulus::Create(n, { 60, scale_bits, 60 }));
+	auto context = SEALContext::Create(parms);
+
+	KeyGenerator keygen(context);
+	RelinKeys relin_keys = keygen.relin_keys();
+	Encryptor encryptor(context, keygen.public_key());
+	Evaluator evaluator(context);
+	Decryptor decryptor(context, keygen.secret_key());
+	CKKSEncoder encoder(context);
+
+	VelocityInputs inputs(encoder.slot_count());
+	Plaintext plain_initial_vel, plain_times, plain_acc, plain_final_vel;
+	Ciphertext enc_initial_vel, enc_times, enc_acc, enc_final_vel;
+	vector<double> final_vel;
+
+	for(auto _ : state)
+	{
+		encoder.encode(inputs.times, scale, plain_times);
+		encoder.encode(inputs.acc, scale, plain_acc);
+		encryptor.encrypt(plain_times, enc_times);
+		encryptor.encrypt(plain_acc, enc_acc);
+
+		evaluator.multiply(enc_acc, enc_times, enc_final_vel);
+		evaluator.relinearize_inplace(enc_final_vel, relin_keys);
+		evaluator.rescale_to_next_inplace(enc_final_vel);
+
+		//Encode v_i directly at the product's level and exact scale
+		encoder.encode(inputs.initial_velocity, enc_final_vel.parms_id(), enc_final_vel.scale(), plain_initial_vel);
+		encryptor.encrypt(plain_initial_vel, enc_initial_vel);
+		evaluator.add_inplace(enc_final_vel, enc_initial_vel);
+
+		decryptor.decrypt(enc_final_vel, plain_final_vel);
+		encoder.decode(plain_final_vel, final_vel);
+	}
+
+	state.SetItemsProcessed(state.iterations() * encoder.slot_count());
+	state.counters["max_abs_error"] = inputs.max_error(final_vel);
+	state.counters["scale_bits"] = scale_bits;
+}
+
+BENCHMARK(BM_VelocityFixedPointBFV)->Arg(8)->Arg(12)->Arg(16)->Arg(20)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_VelocityCKKS)->Arg(8)->Arg(12)->Arg(16)->Arg(20)->Unit(benchmark::kMillisecond);
+
+//Ring dimensions 4096 through 32768
+#define SEAL_BENCHMARK(fn, scheme) \
+	BENCHMARK_TEMPLATE(fn, scheme)->RangeMultiplier(2)->Range(4096, 32768)->Unit(benchmark::kMicrosecond)
+
+SEAL_BENCHMARK(BM_Encode, scheme_type::BFV);
+SEAL_BENCHMARK(BM_Encrypt, scheme_type::BFV);
+SEAL_BENCHMARK(BM_Multiply, scheme_type::BFV);
+SEAL_BENCHMARK(BM_Relinearize, scheme_type::BFV);
+SEAL_BENCHMARK(BM_ModSwitch, scheme_type::BFV);
+SEAL_BENCHMARK(BM_Add, scheme_type::BFV);
+SEAL_BENCHMARK(BM_Rotate, scheme_type::BFV);
+SEAL_BENCHMARK(BM_Decrypt, scheme_type::BFV);
+SEAL_BENCHMARK(BM_Decode, scheme_type::BFV);
+
+SEAL_BENCHMARK(BM_Encode, scheme_type::CKKS);
+SEAL_BENCHMARK(BM_Encrypt, scheme_type::CKKS);
+SEAL_BENCHMARK(BM_Multiply, scheme_type::CKKS);
+SEAL_BENCHMARK(BM_Relinearize, scheme_type::CKKS);
+SEAL_BENCHMARK(BM_ModSwitch, scheme_type::CKKS);
+SEAL_BENCHMARK(BM_Add, scheme_type::CKKS);
+SEAL_BENCHMARK(BM_Rotate, scheme_type::CKKS);
+SEAL_BENCHMARK(BM_Decrypt, scheme_type::CKKS);
+SEAL_BENCHMARK(BM_Decode, scheme_type::CKKS);
+
+BENCHMARK_MAIN();
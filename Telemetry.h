@@ -0,0 +1,113 @@
+/****************************************/
+/* Noise and scale telemetry            */
+/* Records the decryption margin after  */
+/* every operation, alongside the phase */
+/* timings, and exports both as CSV     */
+/****************************************/
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <time.h>
+
+class Telemetry
+{
+public:
+	Telemetry()
+		: enabled_(false), overhead_(0), min_margin_index_(-1)
+	{
+	}
+
+	//Turns recording on; the CSV is written to csv_path by write()
+	void enable(const std::string &csv_path)
+	{
+		enabled_ = true;
+		csv_path_ = csv_path;
+	}
+
+	bool enabled() const
+	{
+		return enabled_;
+	}
+
+	//A quantity that has to stay above zero for the result to decrypt
+	//correctly (noise budget, capacity, modulus headroom), in bits
+	void margin(const std::string &op, const std::string &metric, double value)
+	{
+		add("margin", op, metric, value);
+		if(min_margin_index_ < 0 || value < rows_[min_margin_index_].value)
+			min_margin_index_ = rows_.size() - 1;
+	}
+
+	//Any other per-operation quantity, such as level or scale
+	void value(const std::string &op, const std::string &metric, double value)
+	{
+		add("value", op, metric, value);
+	}
+
+	void timing(const std::string &phase, clock_t ticks)
+	{
+		add("time", phase, "seconds", ((double)ticks)/CLOCKS_PER_SEC);
+	}
+
+	//Probing costs decryptions and estimates that must not count towards the
+	//phase being timed. Probes add their cost here and phases subtract it.
+	void add_overhead(clock_t ticks)
+	{
+		overhead_ += ticks;
+	}
+
+	clock_t take_overhead()
+	{
+		clock_t ticks = overhead_;
+		overhead_ = 0;
+		return ticks;
+	}
+
+	void report(std::ostream &out) const
+	{
+		if(min_margin_index_ < 0)
+			return;
+		const Row &row = rows_[min_margin_index_];
+		out << "Minimum Margin        : " << row.value << " bits (" << row.metric << " after " << row.op << ")" << std::endl;
+	}
+
+	bool write() const
+	{
+		std::ofstream csv(csv_path_.c_str());
+		if(!csv)
+			return false;
+
+		csv << "kind,op,metric,value" << std::endl;
+		for(size_t i = 0; i < rows_.size(); i++)
+			csv << rows_[i].kind << "," << rows_[i].op << "," << rows_[i].metric << "," << rows_[i].value << std::endl;
+		return true;
+	}
+
+private:
+	struct Row
+	{
+		std::string kind;
+		std::string op;
+		std::string metric;
+		double value;
+	};
+
+	void add(const std::string &kind, const std::string &op, const std::string &metric, double value)
+	{
+		Row row = { kind, op, metric, value };
+		rows_.push_back(row);
+	}
+
+	bool enabled_;
+	std::string csv_path_;
+	clock_t overhead_;
+	std::vector<Row> rows_;
+	long min_margin_index_;
+};
+
+#endif
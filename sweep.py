@@ -0,0 +1,313 @@
+#!/usr/bin/env python3
+"""Parameter and security-level sweep for the velocity calculators.
+
+Runs every calculator across security levels, ring dimensions and record
+counts, and stores the phase timings as a versioned baseline file. A
+baseline can be compared with an earlier one. Phases whose timings got
+significantly slower (one-sided Welch t-test) are flagged.
+
+    sweep.py run --label seal-3.4 [--compare baselines/seal-3.3.json]
+    sweep.py compare baselines/seal-3.3.json baselines/seal-3.4.json
+"""
+
+import argparse
+import datetime
+import json
+import math
+import os
+import platform
+import re
+import subprocess
+import sys
+
+BASELINE_FORMAT = 1
+
+# Calculators and whether they take --security/--ring-dim/--n. PalisadeBGV
+# uses hand-picked single-modulus parameters, so it only runs as-is.
+PROGRAMS = [
+    ("SealBFV", True),
+    ("SEALCkks", True),
+    ("PalisadeBFV", True),
+    ("PalisadeCKKS", True),
+    ("PalisadeBGV", False),
+    ("HElibBGV", True),
+]
+
+PHASES = [
+    ("Parameter Generation", "parameter_generation"),
+    ("Key Generation", "key_generation"),
+    ("Encryption", "encryption"),
+    ("Evaluation (v_i + at)", "evaluation"),
+    ("Decryption", "decryption"),
+    ("Compaction", "compaction"),
+]
+
+# Calculator exit statuses: the configuration was rejected (e.g. no secure
+# parameters for it), or the result failed the program's own check. Any
+# other non-zero status is a crash.
+EXIT_REJECTED = 2
+EXIT_INCORRECT = 3
+
+TIMING_LINE = re.compile(r"^(.+?)\s*:\s*([-+0-9.eE]+)\s*$")
+
+
+def parse_timings(output):
+    labels = dict(PHASES)
+    timings = {}
+    for line in output.splitlines():
+        match = TIMING_LINE.match(line)
+        if match and match.group(1) in labels:
+            timings[labels[match.group(1)]] = float(match.group(2))
+    return timings
+
+
+def run_config(binary, args, repeats, timeout):
+    """Runs one configuration repeats times and collects the samples per
+    phase. Returns ("ok", samples), ("skipped", reason) if the program
+    rejected the configuration, or ("failed", reason) if it timed out,
+    crashed or produced a wrong result."""
+    samples = {}
+    for _ in range(repeats):
+        try:
+            proc = subprocess.run([binary] + args, stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+                                  universal_newlines=True, timeout=timeout)
+        except subprocess.TimeoutExpired:
+            return "failed", "timed out after %ds" % timeout
+        if proc.returncode == EXIT_INCORRECT:
+            return "failed", "result failed its correctness check"
+        if proc.returncode != 0:
+            reason = proc.stderr.strip().splitlines()
+            reason = reason[-1] if reason else "exit status %d" % proc.returncode
+            return ("skipped" if proc.returncode == EXIT_REJECTED else "failed"), reason
+        for phase, seconds in parse_timings(proc.stdout).items():
+            samples.setdefault(phase, []).append(seconds)
+    return "ok", samples
+
+
+def config_key(result):
+    return (result["program"], result["security"], result["ring_dim"], result["n"])
+
+
+def config_name(key):
+    program, security, ring_dim, n = key
+    if security is None:
+        return "%s (fixed parameters)" % program
+    return "%s sec=%d ring=%d n=%d" % (program, security, ring_dim, n)
+
+
+def git_revision():
+    try:
+        return subprocess.check_output(["git", "describe", "--always", "--dirty"],
+                                       stderr=subprocess.DEVNULL, universal_newlines=True).strip()
+    except (OSError, subprocess.CalledProcessError):
+        return None
+
+
+def sweep(args):
+    results = []
+    for program, configurable in PROGRAMS:
+        if args.programs and program not in args.programs:
+            continue
+        binary = os.path.join(args.bin_dir, program)
+        if not os.path.exists(binary):
+            print("%-40s not built, skipped" % program, file=sys.stderr)
+            continue
+
+        if configurable:
+            configs = [(s, r, n) for s in args.security for r in args.ring_dims for n in args.n]
+        else:
+            configs = [(None, None, None)]
+
+        for security, ring_dim, n in configs:
+            flags = []
+            if configurable:
+                flags = ["--security", str(security), "--ring-dim", str(ring_dim), "--n", str(n)]
+            result = {"program": program, "security": security, "ring_dim": ring_dim, "n": n}
+            status, outcome = run_config(binary, flags, args.repeats, args.timeout)
+            result["status"] = status
+            if status != "ok":
+                result["reason"] = outcome
+                print("%-40s %s: %s" % (config_name(config_key(result)), status, outcome), file=sys.stderr)
+            else:
+                result["samples"] = outcome
+                print("%-40s evaluation %.6fs" % (config_name(config_key(result)), mean(outcome.get("evaluation", [0]))),
+                      file=sys.stderr)
+            results.append(result)
+    return results
+
+
+def write_baseline(args, results):
+    path = os.path.join(args.out_dir, args.label + ".json")
+    if os.path.exists(path) and not args.force:
+        sys.exit("%s exists; pick another --label or pass --force" % path)
+    os.makedirs(args.out_dir, exist_ok=True)
+
+    baseline = {
+        "format": BASELINE_FORMAT,
+        "label": args.label,
+        "created": datetime.datetime.utcnow().replace(microsecond=0).isoformat() + "Z",
+        "host": platform.node(),
+        "git_revision": git_revision(),
+        "repeats": args.repeats,
+        "results": results,
+    }
+    with open(path, "w") as out:
+        json.dump(baseline, out, indent=1)
+    print("Baseline written to %s" % path, file=sys.stderr)
+    return baseline
+
+
+def load_baseline(path):
+    with open(path) as f:
+        baseline = json.load(f)
+    if baseline.get("format") != BASELINE_FORMAT:
+        sys.exit("%s: unsupported baseline format %r" % (path, baseline.get("format")))
+    return baseline
+
+
+# Statistics
+
+def mean(xs):
+    return sum(xs) / len(xs)
+
+
+def variance(xs):
+    m = mean(xs)
+    return sum((x - m) ** 2 for x in xs) / (len(xs) - 1)
+
+
+def betainc(a, b, x):
+    """Regularized incomplete beta function I_x(a, b), by Lentz's continued fraction."""
+    if x <= 0:
+        return 0.0
+    if x >= 1:
+        return 1.0
+    if x > (a + 1) / (a + b + 2):
+        return 1.0 - betainc(b, a, 1.0 - x)
+
+    front = math.exp(math.lgamma(a + b) - math.lgamma(a) - math.lgamma(b) + a * math.log(x) + b * math.log(1 - x)) / a
+    tiny = 1e-300
+    c, d = 1.0, 1.0 - (a + b) * x / (a + 1)
+    d = 1.0 / (d if abs(d) > tiny else tiny)
+    f = d
+    for m in range(1, 200):
+        for numerator in (m * (b - m) * x / ((a + 2 * m - 1) * (a + 2 * m)),
+                          -(a + m) * (a + b + m) * x / ((a + 2 * m) * (a + 2 * m + 1))):
+            d = 1.0 + numerator * d
+            d = 1.0 / (d if abs(d) > tiny else tiny)
+            c = 1.0 + numerator / c
+            c = c if abs(c) > tiny else tiny
+            f *= c * d
+        if abs(c * d - 1.0) < 1e-12:
+            break
+    return front * f
+
+
+def welch_slower(old, new):
+    """One-sided Welch t-test that new has a larger mean than old. Returns the p-value."""
+    var_old = variance(old) / len(old)
+    var_new = variance(new) / len(new)
+    diff = mean(new) - mean(old)
+    if var_old + var_new == 0:
+        return 0.0 if diff > 0 else 1.0
+
+    t = diff / math.sqrt(var_old + var_new)
+    df = (var_old + var_new) ** 2 / (var_old ** 2 / (len(old) - 1) + var_new ** 2 / (len(new) - 1))
+    tail = 0.5 * betainc(df / 2, 0.5, df / (df + t * t))
+    return tail if t > 0 else 1.0 - tail
+
+
+def compare(old, new, alpha, min_slowdown, out):
+    """Writes the comparison report and returns the number of regressions:
+    significant slowdowns plus configurations that went from ok to failed."""
+    old_results = dict((config_key(r), r) for r in old["results"])
+    new_results = dict((config_key(r), r) for r in new["results"])
+
+    out.write("Comparing %s (%s) -> %s (%s)\n" % (old["label"], old.get("git_revision"), new["label"], new.get("git_revision")))
+    out.write("Flagged when slower by at least %.0f%% with p < %g\n\n" % (min_slowdown * 100, alpha))
+    out.write("%-40s %-22s %12s %12s %8s %9s\n" % ("configuration", "phase", "old (s)", "new (s)", "change", "p"))
+
+    regressions = 0
+    for key in sorted(new_results, key=lambda k: tuple("" if v is None else str(v) for v in k)):
+        new_result = new_results[key]
+        old_result = old_results.get(key)
+        if old_result is None:
+            out.write("%-40s new configuration\n" % config_name(key))
+            continue
+        if new_result["status"] != "ok" or old_result["status"] != "ok":
+            if new_result["status"] != old_result["status"]:
+                broke = old_result["status"] == "ok" and new_result["status"] == "failed"
+                regressions += broke
+                out.write("%-40s %s -> %s%s\n" % (config_name(key), old_result["status"], new_result["status"],
+                                                  "  FAILED" if broke else ""))
+            continue
+
+        for _, phase in PHASES:
+            old_samples = old_result["samples"].get(phase, [])
+            new_samples = new_result["samples"].get(phase, [])
+            if len(old_samples) < 2 or len(new_samples) < 2:
+                continue
+            old_mean, new_mean = mean(old_samples), mean(new_samples)
+            change = (new_mean - old_mean) / old_mean if old_mean > 0 else 0.0
+            p = welch_slower(old_samples, new_samples)
+            flagged = p < alpha and change >= min_slowdown
+            regressions += flagged
+            out.write("%-40s %-22s %12.6f %12.6f %+7.1f%% %9.2g%s\n" % (config_name(key), phase, old_mean, new_mean,
+                                                                       change * 100, p, "  SLOWER" if flagged else ""))
+
+    for key in old_results:
+        if key not in new_results:
+            out.write("%-40s missing from %s\n" % (config_name(key), new["label"]))
+
+    out.write("\n%d regression%s\n" % (regressions, "" if regressions == 1 else "s"))
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest="command")
+
+    run = commands.add_parser("run", help="sweep the calculators and write a baseline")
+    run.add_argument("--bin-dir", default=".", help="directory holding the built calculators")
+    run.add_argument("--programs", nargs="+", help="subset of calculators to run")
+    run.add_argument("--security", nargs="+", type=int, default=[128, 192, 256])
+    run.add_argument("--ring-dims", nargs="+", type=int, default=[4096, 8192, 16384, 32768])
+    run.add_argument("--n", nargs="+", type=int, default=[100, 1000, 2760])
+    run.add_argument("--repeats", type=int, default=5, help="runs per configuration (at least 2 for comparisons)")
+    run.add_argument("--timeout", type=int, default=600, help="seconds allowed per run")
+    run.add_argument("--label", default=datetime.datetime.utcnow().strftime("%Y%m%d-%H%M%S"),
+                     help="baseline version, e.g. the library versions under test")
+    run.add_argument("--out-dir", default="baselines")
+    run.add_argument("--force", action="store_true", help="overwrite an existing baseline with the same label")
+    run.add_argument("--compare", metavar="BASELINE", help="compare the new baseline against this one")
+
+    cmp = commands.add_parser("compare", help="compare two stored baselines")
+    cmp.add_argument("old")
+    cmp.add_argument("new")
+
+    for p in (run, cmp):
+        p.add_argument("--alpha", type=float, default=0.01, help="significance level")
+        p.add_argument("--min-slowdown", type=float, default=0.05, help="smallest relative slowdown to flag")
+        p.add_argument("--report", help="also write the comparison report to this file")
+
+    args = parser.parse_args()
+    if args.command == "run":
+        old = load_baseline(args.compare) if args.compare else None
+        new = write_baseline(args, sweep(args))
+    elif args.command == "compare":
+        old, new = load_baseline(args.old), load_baseline(args.new)
+    else:
+        parser.print_help()
+        return 2
+
+    if old is None:
+        return 0
+    regressions = compare(old, new, args.alpha, args.min_slowdown, sys.stdout)
+    if args.report:
+        with open(args.report, "w") as report:
+            compare(old, new, args.alpha, args.min_slowdown, report)
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())